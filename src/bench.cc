@@ -0,0 +1,484 @@
+#include "switch.h"
+#include "fdb.h"
+#include "clock.h"
+#include "client-table.h"
+#include "epoch.h"
+#include "vars.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <new>
+#include <vector>
+
+using namespace distributor;
+
+// allocations made by this thread, counted by operator new below. thread
+// local, so the logger thread does not count.
+static thread_local uint64_t allocs = 0;
+
+void* operator new (size_t size) {
+    allocs++;
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[] (size_t size) {
+    return operator new(size);
+}
+
+void operator delete (void *p) noexcept {
+    free(p);
+}
+
+void operator delete[] (void *p) noexcept {
+    free(p);
+}
+
+// BenchSwitch: Switch that only counts what it would send.
+class BenchSwitch : public Switch {
+public:
+    BenchSwitch () : sent(0) {}
+
+    using Switch::Plug;
+    using Switch::Unplug;
+    using Switch::Forward;
+
+    uint64_t sent;
+
+protected:
+    void Send (port_t, const uint8_t *, size_t) {
+        sent++;
+    }
+};
+
+// a forwarding scenario. hosts are spread evenly over ports, ports evenly
+// over networks (host h is on port h % ports, port p on network p % nets),
+// and frames go between random hosts of the same network.
+struct forward_case {
+    const char *name;
+    size_t ports;
+    size_t nets;
+    size_t macs;
+
+    // percentage of frames to the broadcast address.
+    unsigned broadcast;
+
+    // unplug a port and plug it back every churn frames, 0 for never.
+    size_t churn;
+
+    // don't learn hosts before timing, every frame has a new source.
+    bool learn;
+
+    uint64_t frames;
+};
+
+// what an FDB scenario times.
+enum fdb_op {
+    F_INSERT = 0,
+    F_REFRESH = 1,
+    F_LOOKUP = 2,
+    F_MISS = 3,
+    F_DISCARD = 4,
+    F_AGE = 5,
+    F_SPRAY = 6
+};
+
+// an FDB scenario: macs entries (one network) learned on ports ports. for
+// spray, ports ports send random sources to a network of at most macs
+// entries, while new ports keep joining.
+struct fdb_case {
+    const char *name;
+    enum fdb_op op;
+    size_t ports;
+    size_t macs;
+    uint64_t ops;
+};
+
+// what a client table scenario times.
+enum client_op {
+    C_INSERT = 0,
+    C_LOOKUP = 1,
+    C_REMOVE = 2
+};
+
+// a client table scenario: clients clients, one per address.
+struct client_case {
+    const char *name;
+    enum client_op op;
+    size_t clients;
+    uint64_t ops;
+};
+
+// a frame of trace: source and destination hosts (BROADCAST for broadcast),
+// and port index of source, known along with the frame as in a worker.
+struct trace_frame {
+    uint32_t src;
+    uint32_t dst;
+    port_index_t index;
+};
+
+static const uint32_t BROADCAST = UINT32_MAX;
+static const size_t TRACE_MAX = 1 << 20;
+static const size_t FRAME_SIZE = 64;
+static const size_t AGE_BUDGET = 1024;
+static const size_t COLLECT_EVERY = 1024;
+static const uint64_t NEWCOMER_EVERY = 1000;
+
+static const char *filter = nullptr;
+
+static uint64_t now_ns () {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t xorshift (uint64_t &state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// write address of host to p, locally administered unicast.
+static void set_mac (uint8_t *p, uint32_t host) {
+    p[0] = 0x02;
+    p[1] = 0x00;
+    p[2] = host >> 24;
+    p[3] = host >> 16;
+    p[4] = host >> 8;
+    p[5] = host;
+}
+
+// address of client i: 10.0.0.0/8, port 4000 and up.
+static struct sockaddr_in client_addr (uint32_t i) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(struct sockaddr_in));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(0x0a000000 | (i & 0xffffff));
+    addr.sin_port = htons(4000 + (i >> 24));
+    return addr;
+}
+
+static struct ether_addr host_addr (uint32_t host) {
+    struct ether_addr addr;
+    set_mac(addr.ether_addr_octet, host);
+    return addr;
+}
+
+static void set_frame (uint8_t *frame, const struct trace_frame &t) {
+    if (t.dst == BROADCAST) memset(frame, 0xff, ETHER_ADDR_LEN);
+    else set_mac(frame, t.dst);
+    set_mac(frame + ETHER_ADDR_LEN, t.src);
+}
+
+static bool selected (const char *name) {
+    return filter == nullptr || strstr(name, filter) != nullptr;
+}
+
+// print a result: "bench <name> [key value]...", params are the key value
+// pairs of the scenario.
+static void report (const char *name, const char *params, uint64_t frames, uint64_t ns, uint64_t nallocs, const char *extra) {
+    printf("bench %s %s frames %" PRIu64 " ns_per_frame %.2f frames_per_s %.0f allocs_per_frame %.4f%s\n",
+        name, params, frames, (double) ns / frames, frames * 1e9 / ns, (double) nallocs / frames, extra);
+    fflush(stdout);
+}
+
+static void run_forward (const struct forward_case &c) {
+    if (!selected(c.name)) return;
+
+    BenchSwitch sw;
+    uint8_t frame[FRAME_SIZE] = {};
+    uint64_t state = 88172645463325252ULL;
+    size_t per_net = c.macs / c.nets;
+
+    // port indexes, by port.
+    std::vector<port_index_t> index (c.ports + 1);
+    for (size_t p = 0; p < c.ports; p++) index[p + 1] = sw.Plug(p % c.nets + 1, p + 1);
+
+    // every host says hello, so destinations are known.
+    if (!c.learn) {
+        for (uint32_t h = 0; h < c.macs; h++) {
+            struct trace_frame t = { h, BROADCAST, 0 };
+            set_frame(frame, t);
+            sw.Forward(index[h % c.ports + 1], h % c.ports + 1, frame, sizeof(frame));
+        }
+    }
+
+    std::vector<struct trace_frame> trace (c.frames < TRACE_MAX ? c.frames : TRACE_MAX);
+
+    for (size_t i = 0; i < trace.size(); i++) {
+        uint32_t src = c.learn ? i % c.macs : xorshift(state) % c.macs;
+        uint32_t dst = BROADCAST;
+
+        // another host of the same network.
+        if (xorshift(state) % 100 >= c.broadcast && per_net > 1) {
+            size_t k = (src / c.nets + 1 + xorshift(state) % (per_net - 1)) % per_net;
+            dst = src % c.nets + c.nets * k;
+        }
+
+        trace[i].src = src;
+        trace[i].dst = dst;
+        trace[i].index = index[src % c.ports + 1];
+    }
+
+    sw.sent = 0;
+    uint64_t churned = 0;
+    uint64_t a = allocs;
+    uint64_t start = now_ns();
+
+    for (uint64_t i = 0, j = 0; i < c.frames; i++) {
+        const struct trace_frame &t = trace[j];
+        if (++j == trace.size()) j = 0;
+
+        if (c.churn != 0 && i % c.churn == c.churn - 1) {
+            port_t port = churned++ % c.ports + 1;
+            sw.Unplug(port);
+            index[port] = sw.Plug((port - 1) % c.nets + 1, port);
+        }
+
+        set_frame(frame, t);
+        sw.Forward(t.index, t.src % c.ports + 1, frame, sizeof(frame));
+    }
+
+    uint64_t ns = now_ns() - start;
+    uint64_t nallocs = allocs - a;
+
+    char params[256], extra[128];
+    snprintf(params, sizeof(params), "ports %zu nets %zu macs %zu broadcast_pct %u churn %zu", c.ports, c.nets, c.macs, c.broadcast, c.churn);
+    snprintf(extra, sizeof(extra), " sent_per_frame %.2f", (double) sw.sent / c.frames);
+    report(c.name, params, c.frames, ns, nallocs, extra);
+}
+
+// fill fdb with macs entries on ports ports of network net.
+static void fill_fdb (Fdb &fdb, net_index_t net, const struct fdb_case &c) {
+    for (uint32_t h = 0; h < c.macs; h++) fdb.Insert(net, h % c.ports + 1, host_addr(h));
+}
+
+static void run_fdb (const struct fdb_case &c) {
+    if (!selected(c.name)) return;
+
+    Fdb *fdb = c.op == F_SPRAY ? new Fdb(DIST_FDB_MAX_PORT, c.macs, c.macs) : new Fdb(c.macs, c.macs, c.macs);
+    net_index_t net = fdb->Open(1);
+    uint64_t state = 88172645463325252ULL;
+    uint64_t ops = c.ops, found = 0, newcomers = 0;
+
+    if (c.op != F_INSERT && c.op != F_SPRAY) fill_fdb(*fdb, net, c);
+
+    uint64_t a = allocs;
+    uint64_t start = now_ns();
+
+    switch (c.op) {
+        case F_INSERT:
+            // new entries, table grows as it goes.
+            ops = c.macs;
+            fill_fdb(*fdb, net, c);
+            break;
+        case F_REFRESH:
+            // known entries on their own port.
+            for (uint64_t i = 0; i < ops; i++) {
+                uint32_t h = xorshift(state) % c.macs;
+                fdb->Insert(net, h % c.ports + 1, host_addr(h));
+            }
+            break;
+        case F_LOOKUP:
+            for (uint64_t i = 0; i < ops; i++) {
+                found += fdb->Lookup(net, host_addr(xorshift(state) % c.macs)) != 0;
+            }
+            break;
+        case F_MISS:
+            for (uint64_t i = 0; i < ops; i++) {
+                found += fdb->Lookup(net, host_addr(c.macs + xorshift(state) % c.macs)) != 0;
+            }
+            break;
+        case F_DISCARD: {
+            // a frame is an entry removed.
+            ops = 0;
+            for (size_t p = 0; p < c.ports; p++) ops += fdb->Discard(net, p + 1);
+            break;
+        }
+        case F_AGE: {
+            // a frame is an entry aged out, AGE_BUDGET visited per call.
+            uint32_t later = Clock::Now() + DIST_FDB_AGEING + 1;
+            size_t before = fdb->Size();
+
+            for (;;) {
+                size_t budget = AGE_BUDGET;
+                if (fdb->Age(later, budget)) break;
+            }
+
+            ops = before - fdb->Size();
+            break;
+        }
+        case F_SPRAY: {
+            // a frame is a sprayed source. found is newcomers still known
+            // at the end.
+            for (uint64_t i = 0; i < ops; i++) {
+                fdb->Insert(net, i % c.ports + 1, host_addr((uint32_t) xorshift(state) | 0x80000000U));
+
+                if (i % NEWCOMER_EVERY == 0) {
+                    fdb->Insert(net, c.ports + 1 + newcomers, host_addr(newcomers));
+                    newcomers++;
+                }
+            }
+
+            for (uint32_t k = 0; k < newcomers; k++) found += fdb->Lookup(net, host_addr(k)) != 0;
+            break;
+        }
+    }
+
+    uint64_t ns = now_ns() - start;
+    uint64_t nallocs = allocs - a;
+
+    char params[256], extra[128];
+    snprintf(params, sizeof(params), "ports %zu nets 1 macs %zu broadcast_pct 0 churn 0", c.ports, c.macs);
+    snprintf(extra, sizeof(extra), " found %" PRIu64 " entries %zu", found, fdb->Size());
+    if (c.op == F_SPRAY) snprintf(extra + strlen(extra), sizeof(extra) - strlen(extra), " newcomers %" PRIu64, newcomers);
+    report(c.name, params, ops, ns, nallocs, extra);
+
+    delete fdb;
+}
+
+static void run_client (const struct client_case &c) {
+    if (!selected(c.name)) return;
+
+    EpochDomain epoch (1);
+    ClientTable *table = new ClientTable(epoch);
+    uint64_t state = 88172645463325252ULL;
+    uint64_t ops = c.ops, found = 0;
+
+    // clients are created outside of timing, table takes them over.
+    std::vector<Client *> clients (c.clients);
+    for (uint32_t i = 0; i < c.clients; i++) clients[i] = new Client(client_addr(i), i + 1, -1);
+
+    if (c.op != C_INSERT) {
+        for (Client *client : clients) table->Insert(client);
+    }
+
+    uint64_t a = allocs;
+    uint64_t start = now_ns();
+
+    switch (c.op) {
+        case C_INSERT:
+            // table grows as it goes.
+            ops = c.clients;
+            for (Client *client : clients) table->Insert(client);
+            break;
+        case C_LOOKUP:
+            for (uint64_t i = 0; i < ops; i++) {
+                found += table->Find(ClientTable::Key(client_addr(xorshift(state) % c.clients))) != nullptr;
+            }
+            break;
+        case C_REMOVE:
+            // removed clients are freed a round later, as by workers.
+            ops = c.clients;
+            for (uint32_t i = 0; i < c.clients; i++) {
+                table->Remove(ClientTable::Key(client_addr(i)));
+                if (i % COLLECT_EVERY == COLLECT_EVERY - 1) table->Collect();
+            }
+            table->Collect();
+            break;
+    }
+
+    uint64_t ns = now_ns() - start;
+    uint64_t nallocs = allocs - a;
+
+    char params[64], extra[128];
+    snprintf(params, sizeof(params), "clients %zu", c.clients);
+    snprintf(extra, sizeof(extra), " found %" PRIu64 " entries %zu", found, table->Size());
+    report(c.name, params, ops, ns, nallocs, extra);
+
+    delete table;
+}
+
+static const struct forward_case forward_cases[] = {
+    // name, ports, nets, macs, broadcast %, churn, learn, frames
+    { "switch-unicast", 2, 1, 2, 0, 0, false, 20000000 },
+    { "switch-unicast", 100, 1, 1000, 0, 0, false, 20000000 },
+    { "switch-unicast", 10000, 1, 10000, 0, 0, false, 10000000 },
+    { "switch-unicast", 1024, 16, 1000000, 0, 0, false, 10000000 },
+    { "switch-unicast", 2000000, 1000000, 2000000, 0, 0, false, 10000000 },
+    { "switch-mixed", 100, 1, 1000, 5, 0, false, 5000000 },
+    { "switch-mixed", 1000, 10, 100000, 1, 0, false, 5000000 },
+    { "switch-broadcast", 10, 1, 10, 100, 0, false, 2000000 },
+    { "switch-broadcast", 1000, 1, 1000, 100, 0, false, 50000 },
+    { "switch-broadcast", 10000, 1, 10000, 100, 0, false, 5000 },
+    { "switch-churn", 100, 1, 1000, 0, 1000, false, 5000000 },
+    { "switch-churn", 1000, 10, 100000, 0, 100, false, 2000000 },
+    { "switch-churn", 20000, 10000, 20000, 0, 1000, false, 10000000 },
+    { "switch-learn", 1024, 16, 1000000, 0, 0, true, 1000000 },
+};
+
+static const struct fdb_case fdb_cases[] = {
+    // name, op, ports, macs, ops
+    { "fdb-insert", F_INSERT, 1000, 10000, 0 },
+    { "fdb-insert", F_INSERT, 1000, 1000000, 0 },
+    { "fdb-refresh", F_REFRESH, 1000, 1000, 20000000 },
+    { "fdb-refresh", F_REFRESH, 1000, 1000000, 10000000 },
+    { "fdb-lookup", F_LOOKUP, 1000, 1000, 20000000 },
+    { "fdb-lookup", F_LOOKUP, 1000, 1000000, 10000000 },
+    { "fdb-miss", F_MISS, 1000, 1000000, 10000000 },
+    { "fdb-discard", F_DISCARD, 10, 1000000, 0 },
+    { "fdb-discard", F_DISCARD, 10000, 1000000, 0 },
+    { "fdb-age", F_AGE, 1000, 1000000, 0 },
+    { "fdb-spray", F_SPRAY, 1, DIST_FDB_MAX_NET, 10000000 },
+    { "fdb-spray", F_SPRAY, 64, DIST_FDB_MAX_NET, 10000000 },
+};
+
+static const struct client_case client_cases[] = {
+    // name, op, clients, ops
+    { "client-insert", C_INSERT, 1000, 0 },
+    { "client-insert", C_INSERT, 100000, 0 },
+    { "client-insert", C_INSERT, 1000000, 0 },
+    { "client-lookup", C_LOOKUP, 1000, 20000000 },
+    { "client-lookup", C_LOOKUP, 100000, 20000000 },
+    { "client-lookup", C_LOOKUP, 1000000, 10000000 },
+    { "client-remove", C_REMOVE, 1000, 0 },
+    { "client-remove", C_REMOVE, 100000, 0 },
+    { "client-remove", C_REMOVE, 1000000, 0 },
+};
+
+void help (const char *me) {
+    fprintf(stderr, "usage: %s [-h] [-f FILTER]\n", me);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "dist-bench: benchmarks of switch, forwarding database and client table.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Prints one line per scenario: \"bench NAME [KEY VALUE]...\". Keys are the\n");
+    fprintf(stderr, "scenario (ports, nets, macs, broadcast_pct, churn, or clients) and the\n");
+    fprintf(stderr, "results (frames, ns_per_frame, frames_per_s, allocs_per_frame). A frame of\n");
+    fprintf(stderr, "an fdb or client scenario is one call, or one entry removed for discard\n");
+    fprintf(stderr, "and age.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "optional arguments:\n");
+    fprintf(stderr, "  -f FILTER        Only run scenarios with FILTER in their name.\n");
+    fprintf(stderr, "  -h               Print this help message.\n");
+}
+
+int main (int argc, char **argv) {
+    char opt;
+
+    while ((opt = getopt(argc, argv, "hf:")) != -1) {
+        switch (opt) {
+            case 'f':
+                filter = optarg;
+                break;
+            case 'h':
+            default:
+                help(argv[0]);
+                return 1;
+        }
+    }
+
+    Clock::Tick();
+
+    for (const struct forward_case &c : forward_cases) run_forward(c);
+    for (const struct fdb_case &c : fdb_cases) run_fdb(c);
+    for (const struct client_case &c : client_cases) run_client(c);
+
+    return 0;
+}
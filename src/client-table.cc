@@ -0,0 +1,156 @@
+#include "client-table.h"
+
+// initial number of slots (power of two).
+#define CLIENT_TABLE_MIN_SZ 16
+
+namespace distributor {
+
+Client* const ClientTable::TOMBSTONE = (Client *) 1;
+
+ClientTable::table::table (size_t size) : slots(size) {
+    mask = size - 1;
+
+    for (size_t i = 0; i < size; i++) {
+        slots[i].key.store(0, std::memory_order_relaxed);
+        slots[i].client.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+ClientTable::ClientTable (EpochDomain &epoch) : _retired_clients(epoch), _retired_tables(epoch) {
+    _table = new table(CLIENT_TABLE_MIN_SZ);
+    _size = 0;
+    _used = 0;
+}
+
+ClientTable::~ClientTable () {
+    struct table *t = _table.load();
+
+    for (size_t i = 0; i <= t->mask; i++) {
+        Client *client = t->slots[i].client.load();
+        if (client != nullptr && client != TOMBSTONE) delete client;
+    }
+
+    delete t;
+}
+
+uint64_t ClientTable::Key (const struct sockaddr_in &address) {
+    return ((uint64_t) address.sin_addr.s_addr << 16) | address.sin_port;
+}
+
+size_t ClientTable::Hash (uint64_t key) {
+    // murmur3 finalizer: every bit of address and port affects the slot.
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+
+    return (size_t) key;
+}
+
+Client* ClientTable::Find (uint64_t key) const {
+    const struct table *t = _table.load(std::memory_order_acquire);
+
+    // at most 3/4 of slots are used, probing always ends at an empty one.
+    for (size_t i = Hash(key) & t->mask;; i = (i + 1) & t->mask) {
+        const struct slot &s = t->slots[i];
+        Client *client = s.client.load(std::memory_order_acquire);
+
+        if (client == nullptr) return nullptr;
+        if (client == TOMBSTONE || s.key.load(std::memory_order_relaxed) != key) continue;
+
+        // slot may have been reused since we read the client, check that the
+        // client really has this key.
+        if (Key(client->AddrRef()) == key) return client;
+    }
+}
+
+void ClientTable::Insert (Client *client) {
+    struct table *t = _table.load(std::memory_order_relaxed);
+
+    if ((_used + 1) * 4 > (t->mask + 1) * 3) {
+        // grow if mostly clients, otherwise just drop tombstones.
+        size_t size = t->mask + 1;
+        while ((_size + 1) * 2 > size) size *= 2;
+        Rebuild(size);
+        t = _table.load(std::memory_order_relaxed);
+    }
+
+    uint64_t key = Key(client->AddrRef());
+
+    for (size_t i = Hash(key) & t->mask;; i = (i + 1) & t->mask) {
+        struct slot &s = t->slots[i];
+        Client *slot_client = s.client.load(std::memory_order_relaxed);
+        if (slot_client != nullptr && slot_client != TOMBSTONE) continue;
+
+        if (slot_client == nullptr) _used++;
+        s.key.store(key, std::memory_order_relaxed);
+        s.client.store(client, std::memory_order_release);
+        _size++;
+        return;
+    }
+}
+
+void ClientTable::Remove (uint64_t key) {
+    struct table *t = _table.load(std::memory_order_relaxed);
+
+    for (size_t i = Hash(key) & t->mask;; i = (i + 1) & t->mask) {
+        struct slot &s = t->slots[i];
+        Client *client = s.client.load(std::memory_order_relaxed);
+
+        if (client == nullptr) return;
+        if (client == TOMBSTONE || s.key.load(std::memory_order_relaxed) != key) continue;
+
+        s.client.store(TOMBSTONE, std::memory_order_release);
+        _retired_clients.Retire(client);
+        _size--;
+        return;
+    }
+}
+
+void ClientTable::Clear () {
+    struct table *t = _table.load(std::memory_order_relaxed);
+
+    _table.store(new table(CLIENT_TABLE_MIN_SZ), std::memory_order_release);
+
+    for (size_t i = 0; i <= t->mask; i++) {
+        Client *client = t->slots[i].client.load(std::memory_order_relaxed);
+        if (client != nullptr && client != TOMBSTONE) _retired_clients.Retire(client);
+    }
+
+    _retired_tables.Retire(t);
+    _size = 0;
+    _used = 0;
+}
+
+void ClientTable::Collect () {
+    if (!_retired_clients.Empty()) _retired_clients.Collect();
+    if (!_retired_tables.Empty()) _retired_tables.Collect();
+}
+
+size_t ClientTable::Size () const {
+    return _size;
+}
+
+void ClientTable::Rebuild (size_t size) {
+    struct table *old = _table.load(std::memory_order_relaxed);
+    struct table *t = new table(size);
+
+    for (size_t i = 0; i <= old->mask; i++) {
+        Client *client = old->slots[i].client.load(std::memory_order_relaxed);
+        if (client == nullptr || client == TOMBSTONE) continue;
+
+        uint64_t key = old->slots[i].key.load(std::memory_order_relaxed);
+        size_t j = Hash(key) & t->mask;
+        while (t->slots[j].client.load(std::memory_order_relaxed) != nullptr) j = (j + 1) & t->mask;
+        t->slots[j].key.store(key, std::memory_order_relaxed);
+        t->slots[j].client.store(client, std::memory_order_relaxed);
+    }
+
+    // readers still on old array keep seeing valid clients.
+    _table.store(t, std::memory_order_release);
+    _retired_tables.Retire(old);
+    _used = _size;
+}
+
+}
@@ -0,0 +1,95 @@
+#ifndef DIST_CLIENT_TABLE_H
+#define DIST_CLIENT_TABLE_H
+#include "udp-distributor.h"
+#include "epoch.h"
+#include "types.h"
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+namespace distributor {
+
+// ClientTable: client address -> Client table. Flat open addressing: the key
+// (IPv4 address and port packed in 48 bits) is kept in the slot next to the
+// client pointer, so a lookup is one hash and usually one cache line.
+//
+// Written only by the worker that owns the clients, without locks; other
+// threads (scavenger) look clients up concurrently inside an epoch critical
+// section. Removed clients and outgrown slot arrays are retired, not freed,
+// so a concurrent reader never touches freed memory.
+class ClientTable {
+public:
+    ClientTable (EpochDomain &epoch);
+    ~ClientTable ();
+
+    // Get key of a client address.
+    static uint64_t Key (const struct sockaddr_in &address);
+
+    // Find client by key, nullptr if there is none. Safe from any thread
+    // inside an epoch critical section.
+    Client* Find (uint64_t key) const;
+
+    // Call f on every client. Safe from any thread inside an epoch critical
+    // section.
+    template <typename F>
+    void ForEach (F f) const {
+        const struct table *t = _table.load(std::memory_order_acquire);
+
+        for (size_t i = 0; i <= t->mask; i++) {
+            Client *client = t->slots[i].client.load(std::memory_order_acquire);
+            if (client != nullptr && client != TOMBSTONE) f(*client);
+        }
+    }
+
+    // (owner) Add a client, its address must not be in table. Table takes
+    // ownership of client.
+    void Insert (Client *client);
+
+    // (owner) Remove client with key.
+    void Remove (uint64_t key);
+
+    // (owner) Remove all clients.
+    void Clear ();
+
+    // (owner) Free removed clients no reader can still see.
+    void Collect ();
+
+    // Get number of clients.
+    size_t Size () const;
+
+private:
+    struct slot {
+        std::atomic<uint64_t> key;
+        std::atomic<Client *> client;
+    };
+
+    struct table {
+        table (size_t size);
+
+        size_t mask;
+        std::vector<struct slot> slots;
+    };
+
+    // marks a slot whose client was removed, so probing goes on past it.
+    static Client* const TOMBSTONE;
+
+    static size_t Hash (uint64_t key);
+
+    // Move clients to a new slot array of size slots.
+    void Rebuild (size_t size);
+
+    std::atomic<struct table *> _table;
+
+    // number of clients, and of slots not empty (clients and tombstones).
+    size_t _size;
+    size_t _used;
+
+    RetireList<Client> _retired_clients;
+    RetireList<struct table> _retired_tables;
+};
+
+}
+
+#endif // DIST_CLIENT_TABLE_H
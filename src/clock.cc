@@ -0,0 +1,29 @@
+#include "clock.h"
+#include <time.h>
+
+namespace distributor {
+
+std::atomic<uint32_t> Clock::_now (Clock::Read());
+
+uint32_t Clock::Read () {
+    struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+
+    return (uint32_t) ts.tv_sec;
+}
+
+void Clock::Tick () {
+    uint32_t now = Read();
+    uint32_t cur = _now.load(std::memory_order_relaxed);
+
+    // every thread ticks: only write when a second has passed, so the line
+    // stays shared, and never go back to what a late thread read.
+    while (cur < now && !_now.compare_exchange_weak(cur, now, std::memory_order_relaxed)) {}
+}
+
+}
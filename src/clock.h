@@ -0,0 +1,32 @@
+#ifndef DIST_CLOCK_H
+#define DIST_CLOCK_H
+#include <stdint.h>
+#include <atomic>
+
+namespace distributor {
+
+// Clock: process-wide coarse monotonic clock, in seconds from an unspecified
+// start. Packet paths read Now(), which is a plain load, instead of calling
+// time() per frame. Now() only moves forward when someone calls Tick():
+// workers do once per batch, scavenger (or pinger of client) once per tick.
+// Being monotonic, it does not jump with wall clock.
+class Clock {
+public:
+    // Get current time.
+    static uint32_t Now () {
+        return _now.load(std::memory_order_relaxed);
+    }
+
+    // Read system clock and update Now().
+    static void Tick ();
+
+private:
+    // Read system clock.
+    static uint32_t Read ();
+
+    static std::atomic<uint32_t> _now;
+};
+
+}
+
+#endif // DIST_CLOCK_H
@@ -1,5 +1,6 @@
 #include "distributor-client.h"
 #include "log.h"
+#include "clock.h"
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <string.h>
@@ -37,7 +38,7 @@ void DistributorClient::SetNetwork (net_t net) {
             log_error("sendto() returned %zu.\n", s_ret);
             return;
         }
-        _last_sent = time(NULL);
+        _last_sent = Clock::Now();
     }
 }
 
@@ -116,7 +117,7 @@ ssize_t DistributorClient::SendMsg (msg_type_t type) {
         log_error("sendto() returned %zu.\n", s_ret);
         return s_ret;
     }
-    _last_sent = time (NULL);
+    _last_sent = Clock::Now();
     return s_ret;
 }
 
@@ -127,7 +128,7 @@ void DistributorClient::SocketWorker () {
     while (_running) {
         static socklen_t saddr_len = sizeof(struct sockaddr_in);
         ssize_t len = recvfrom(_fd, buffer, DIST_CLIENT_BUF_SZ, 0, (struct sockaddr *) &recv_addr, &saddr_len);
-        _last_recv = time(NULL);
+        _last_recv = Clock::Now();
 
         if (len < 0) {
             log_error("recvfrom(): %s.\n", strerror(errno));
@@ -295,7 +296,7 @@ void DistributorClient::NicWorker () {
             log_error("sendto() returned %zu, but pkt len is %zu.\n", (size_t) s_ret, pkt_len);
             return;
         }
-        _last_sent = time(NULL);
+        _last_sent = Clock::Now();
 
     }
 
@@ -306,6 +307,7 @@ void DistributorClient::Pinger () {
     log_debug("Pinger started.\n");
     while (_running) {
         std::unique_lock<std::mutex> lock (_pinger_mtx);
+        Clock::Tick();
         if (_state == S_IDLE) {
             log_debug("Client running but idle, send init keepalive to server.\n");
             _state = S_CONNECT;
@@ -313,8 +315,8 @@ void DistributorClient::Pinger () {
         } else if (_state == S_CONNECT) {
             SendMsg(M_KEEPALIVE_REQUEST);
         } else {
-            int64_t lastsent_diff = time(NULL) - _last_sent;
-            int64_t lastrecv_diff = time(NULL) - _last_recv;
+            int64_t lastsent_diff = Clock::Now() - _last_sent;
+            int64_t lastrecv_diff = Clock::Now() - _last_recv;
 
             if (lastsent_diff >= DIST_CLIENT_KEEPALIVE && lastrecv_diff >= DIST_CLIENT_KEEPALIVE) {
                 log_debug("Nothing received from server for %" PRIi64 " seconds, send keepalive.\n", lastrecv_diff);
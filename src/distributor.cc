@@ -1,5 +1,6 @@
 #include "udp-distributor.h"
 #include "log.h"
+#include "vars.h"
 #include <stdio.h>
 #include <string.h>
 #include <getopt.h>
@@ -21,7 +22,7 @@ void handle_signal (__attribute__((unused)) int sig) {
 }
 
 void help (const char *me) {
-    fprintf(stderr, "usage: %s [-h] [-b BIND_ADDR] -p BIND_PORT\n", me);
+    fprintf(stderr, "usage: %s [-h] [-b BIND_ADDR] [-B BATCH] [-w WORKERS] [-u] [-g] [-s STATS_SOCKET] -p BIND_PORT\n", me);
     fprintf(stderr, "\n");
     fprintf(stderr, "distributor: virtual ethernet switch.\n");
     fprintf(stderr, "\n");
@@ -30,6 +31,15 @@ void help (const char *me) {
     fprintf(stderr, "\n");
     fprintf(stderr, "optional arguments:\n");
     fprintf(stderr, "  -b BIND_ADDR     Address to bind on (default: 0.0.0.0).\n");
+    fprintf(stderr, "  -B BATCH         Max number of datagrams to read per syscall (default: %d,\n", DIST_WORKER_BATCH);
+    fprintf(stderr, "                   use 1 for lowest latency).\n");
+    fprintf(stderr, "  -w WORKERS       Number of forwarding threads (default: %d). Each network\n", DIST_WORKERS);
+    fprintf(stderr, "                   is forwarded by one of them.\n");
+    fprintf(stderr, "  -u               Use io_uring for socket I/O (falls back to recvmmsg/sendmmsg\n");
+    fprintf(stderr, "                   if not supported by kernel).\n");
+    fprintf(stderr, "  -g               Don't use UDP GRO/GSO (kernel coalescing of datagrams).\n");
+    fprintf(stderr, "  -s STATS_SOCKET  Serve counters on a unix socket at this path (read it\n");
+    fprintf(stderr, "                   with e.g. socat - UNIX-CONNECT:STATS_SOCKET).\n");
     fprintf(stderr, "  -h               Print this help message and exit.\n");
 }
 
@@ -37,12 +47,32 @@ int main (int argc, char **argv) {
     char opt;
     char *bind_addr = nullptr;
     in_port_t port = 0;
+    size_t batch = DIST_WORKER_BATCH;
+    size_t workers = DIST_WORKERS;
+    bool uring = false;
+    bool udp_offload = true;
+    char *stats_path = nullptr;
 
-    while ((opt = getopt(argc, argv, "hb:p:")) != -1) {
+    while ((opt = getopt(argc, argv, "hb:B:w:ugs:p:")) != -1) {
         switch (opt) {
             case 'b':
                 bind_addr = strdup(optarg);
                 continue;
+            case 'B':
+                batch = (size_t) atoi(optarg);
+                continue;
+            case 'w':
+                workers = (size_t) atoi(optarg);
+                continue;
+            case 'u':
+                uring = true;
+                continue;
+            case 'g':
+                udp_offload = false;
+                continue;
+            case 's':
+                stats_path = strdup(optarg);
+                continue;
             case 'p':
                 port = (in_port_t) atoi(optarg);
                 continue;
@@ -63,11 +93,12 @@ int main (int argc, char **argv) {
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
 
-    UdpDistributor dist (bind_addr == nullptr ? INADDR_ANY : inet_addr(bind_addr), htons(port));
+    UdpDistributor dist (bind_addr == nullptr ? INADDR_ANY : inet_addr(bind_addr), htons(port), batch, workers, uring, udp_offload, stats_path);
     ::dist = &dist;
     dist.Start();
     dist.Join();
 
     if (bind_addr != nullptr) free(bind_addr);
+    if (stats_path != nullptr) free(stats_path);
     return 0;
 } 
\ No newline at end of file
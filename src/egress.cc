@@ -0,0 +1,232 @@
+#include "egress.h"
+#include "log.h"
+#include "vars.h"
+#include <string.h>
+#include <errno.h>
+#include <netinet/udp.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif // UDP_SEGMENT
+
+// 64-bit words for one UDP_SEGMENT control message.
+#define GSO_CTRL_WORDS ((CMSG_SPACE(sizeof(uint16_t)) + sizeof(uint64_t) - 1) / sizeof(uint64_t))
+
+namespace distributor {
+
+EgressQueue::EgressQueue (size_t depth) : _msgs(depth), _iovs(depth * 2), _addrs(depth), _hdrs(depth), _errors(depth), _gso_msgs(depth), _gso_first(depth), _gso_segs(depth), _gso_ctrl(depth * GSO_CTRL_WORDS) {
+    _fd = -1;
+    _uring = nullptr;
+    _gso = false;
+    _depth = depth;
+    _pending = 0;
+
+    // each datagram is two iovecs: header and payload.
+    for (size_t i = 0; i < _depth; i++) {
+        _iovs[i * 2].iov_base = &_hdrs[i];
+        _iovs[i * 2].iov_len = sizeof(dist_header_t);
+        memset(&_msgs[i], 0, sizeof(struct mmsghdr));
+        _msgs[i].msg_hdr.msg_iov = &_iovs[i * 2];
+        _msgs[i].msg_hdr.msg_iovlen = 2;
+        _msgs[i].msg_hdr.msg_name = &_addrs[i];
+        _msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+
+        struct msghdr *gso_hdr = &_gso_msgs[i].msg_hdr;
+        gso_hdr->msg_control = &_gso_ctrl[i * GSO_CTRL_WORDS];
+        gso_hdr->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(gso_hdr);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    }
+}
+
+void EgressQueue::SetFd (int fd) {
+    _fd = fd;
+}
+
+void EgressQueue::SetUring (Uring *uring) {
+    _uring = uring;
+}
+
+void EgressQueue::SetGso (bool gso) {
+    _gso = gso;
+}
+
+ssize_t EgressQueue::Queue (const struct sockaddr_in &dst, const dist_header_t &hdr, const uint8_t *payload, size_t size) {
+    if (_pending == _depth) Flush();
+
+    _hdrs[_pending] = hdr;
+    struct iovec &payload_iov = _iovs[_pending * 2 + 1];
+    payload_iov.iov_base = (void *) payload;
+    payload_iov.iov_len = size;
+    _addrs[_pending] = dst;
+    _pending++;
+
+    return sizeof(dist_header_t) + size;
+}
+
+size_t EgressQueue::Flush () {
+    size_t sent = 0;
+    size_t n_msgs = 0;
+
+    if (_pending == 0) return 0;
+
+    if (!_gso) {
+        Send(&_msgs[0], _pending, &_errors[0]);
+
+        for (size_t i = 0; i < _pending; i++) {
+            if (_errors[i] == 0) sent++;
+            else Failed(_errors[i]);
+        }
+
+        n_msgs = _pending;
+    } else {
+        n_msgs = Coalesce();
+        Send(&_gso_msgs[0], n_msgs, &_errors[0]);
+
+        size_t n_retry = 0;
+        for (size_t i = 0; i < n_msgs; i++) {
+            if (_errors[i] == 0) {
+                sent += _gso_segs[i];
+                continue;
+            }
+
+            if (_gso_segs[i] == 1) {
+                Failed(_errors[i]);
+                continue;
+            }
+
+            // GSO not supported by the route or device: stop using it.
+            if (_errors[i] == EIO || _errors[i] == EOPNOTSUPP || _errors[i] == ENOPROTOOPT) {
+                if (_gso) log_warn("UDP GSO send failed (%s), disabling GSO.\n", strerror(_errors[i]));
+                _gso = false;
+            }
+
+            // send its datagrams one by one below. n_retry <= i, so this only
+            // overwrites entries already read.
+            _gso_first[n_retry] = _gso_first[i];
+            _gso_segs[n_retry] = _gso_segs[i];
+            n_retry++;
+        }
+
+        for (size_t r = 0; r < n_retry; r++) {
+            size_t first = _gso_first[r];
+            size_t segs = _gso_segs[r];
+            Send(&_msgs[first], segs, &_errors[0]);
+
+            for (size_t i = 0; i < segs; i++) {
+                if (_errors[i] == 0) sent++;
+                else Failed(_errors[i]);
+            }
+
+            n_msgs += segs;
+        }
+    }
+
+    _counters.datagrams.Add(sent);
+    _counters.messages.Add(n_msgs);
+
+    log_logic("Flushed %zu datagrams in %zu messages, %zu sent.\n", _pending, n_msgs, sent);
+    _pending = 0;
+    return sent;
+}
+
+size_t EgressQueue::Coalesce () {
+    size_t n = 0;
+    size_t i = 0;
+
+    while (i < _pending) {
+        size_t seg_sz = sizeof(dist_header_t) + _iovs[i * 2 + 1].iov_len;
+        size_t total = seg_sz;
+        size_t j = i + 1;
+
+        // take following datagrams to the same client of the same size. one
+        // shorter datagram may end the message.
+        if (seg_sz <= DIST_GSO_MAX_SEG_SZ) {
+            while (j < _pending && j - i < DIST_GSO_MAX_SEGS) {
+                size_t sz = sizeof(dist_header_t) + _iovs[j * 2 + 1].iov_len;
+
+                if (_addrs[j].sin_addr.s_addr != _addrs[i].sin_addr.s_addr || _addrs[j].sin_port != _addrs[i].sin_port) break;
+                if (sz > seg_sz || total + sz > 65507) break;
+
+                total += sz;
+                j++;
+
+                if (sz < seg_sz) break;
+            }
+        }
+
+        struct msghdr *hdr = &_gso_msgs[n].msg_hdr;
+        hdr->msg_name = &_addrs[i];
+        hdr->msg_namelen = sizeof(struct sockaddr_in);
+        hdr->msg_iov = &_iovs[i * 2];
+        hdr->msg_iovlen = (j - i) * 2;
+
+        if (j - i > 1) {
+            hdr->msg_control = &_gso_ctrl[n * GSO_CTRL_WORDS];
+            hdr->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            uint16_t gso_sz = (uint16_t) seg_sz;
+            memcpy(CMSG_DATA(CMSG_FIRSTHDR(hdr)), &gso_sz, sizeof(uint16_t));
+        } else {
+            hdr->msg_control = NULL;
+            hdr->msg_controllen = 0;
+        }
+
+        _gso_first[n] = i;
+        _gso_segs[n] = j - i;
+        n++;
+        i = j;
+    }
+
+    return n;
+}
+
+void EgressQueue::Send (struct mmsghdr *msgs, size_t n, int *errors) {
+    if (_uring != nullptr) {
+        _uring->SendBatch(_fd, msgs, n, errors);
+        return;
+    }
+
+    size_t done = 0;
+
+    while (done < n) {
+        int s_ret = sendmmsg(_fd, &msgs[done], n - done, 0);
+
+        if (s_ret < 0) {
+            if (errno == EINTR) continue;
+            // first message of the remaining batch failed, skip it.
+            errors[done++] = errno;
+            continue;
+        }
+
+        for (int i = 0; i < s_ret; i++) errors[done + i] = 0;
+        done += s_ret;
+    }
+}
+
+void EgressQueue::Failed (int err) {
+    if (err == ENOBUFS) _counters.no_buffer.Add();
+    else if (err == EAGAIN || err == EWOULDBLOCK) _counters.would_block.Add();
+    else _counters.failed.Add();
+
+    log_error("sendmsg(): %s.\n", strerror(err));
+}
+
+size_t EgressQueue::Pending () const {
+    return _pending;
+}
+
+uint64_t EgressQueue::GetTxDatagrams () const {
+    return _counters.datagrams.Get();
+}
+
+uint64_t EgressQueue::GetTxMessages () const {
+    return _counters.messages.Get();
+}
+
+const struct EgressQueue::egress_counters& EgressQueue::Counters () const {
+    return _counters;
+}
+
+}
@@ -0,0 +1,95 @@
+#ifndef DIST_EGRESS_H
+#define DIST_EGRESS_H
+#include "types.h"
+#include "uring.h"
+#include "stats.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <vector>
+
+namespace distributor {
+
+// EgressQueue: collect outgoing datagrams and send them with sendmmsg().
+// With UDP GSO, consecutive datagrams of the same size to the same client
+// are sent as one message and split by kernel (or NIC).
+class EgressQueue {
+public:
+    // datagrams sent, messages passed to kernel, and datagrams kernel did
+    // not take: no buffer space (ENOBUFS), socket send buffer full (EAGAIN)
+    // or other errors.
+    struct egress_counters {
+        Counter datagrams;
+        Counter messages;
+        Counter no_buffer;
+        Counter would_block;
+        Counter failed;
+    };
+
+    EgressQueue (size_t depth);
+
+    // Set the socket to send on.
+    void SetFd (int fd);
+
+    // Send through io_uring instead of sendmmsg(). nullptr to switch back.
+    void SetUring (Uring *uring);
+
+    // Send bursts to the same client with UDP GSO.
+    void SetGso (bool gso);
+
+    // Queue a datagram (header + payload) to dst. The payload is not copied, 
+    // it must stay valid until the next Flush(). The queue is flushed first if
+    // it is full. Return the datagram size.
+    ssize_t Queue (const struct sockaddr_in &dst, const dist_header_t &hdr, const uint8_t *payload, size_t size);
+
+    // Send all queued datagrams. Return number of datagrams sent.
+    size_t Flush ();
+
+    // Get number of queued datagrams.
+    size_t Pending () const;
+
+    // Get number of datagrams sent.
+    uint64_t GetTxDatagrams () const;
+
+    // Get number of messages passed to kernel (less than datagrams sent if
+    // GSO coalesced some of them).
+    uint64_t GetTxMessages () const;
+
+    // Get counters.
+    const struct egress_counters& Counters () const;
+
+private:
+    // Build GSO messages out of the queue, return number of messages.
+    size_t Coalesce ();
+
+    // Send n messages, store errno of every message (0 if sent) in errors.
+    void Send (struct mmsghdr *msgs, size_t n, int *errors);
+
+    // Count a datagram not sent because of error err.
+    void Failed (int err);
+
+    int _fd;
+    Uring *_uring;
+    bool _gso;
+    size_t _depth;
+    size_t _pending;
+    std::vector<struct mmsghdr> _msgs;
+    std::vector<struct iovec> _iovs;
+    std::vector<struct sockaddr_in> _addrs;
+    std::vector<dist_header_t> _hdrs;
+    std::vector<int> _errors;
+
+    // coalesced messages, the first datagram and number of datagrams in each
+    // of them, and their UDP_SEGMENT control messages.
+    std::vector<struct mmsghdr> _gso_msgs;
+    std::vector<size_t> _gso_first;
+    std::vector<size_t> _gso_segs;
+    std::vector<uint64_t> _gso_ctrl;
+
+    // stats (written by owner thread only)
+    struct egress_counters _counters;
+};
+
+}
+
+#endif // DIST_EGRESS_H
@@ -0,0 +1,55 @@
+#include "epoch.h"
+
+namespace distributor {
+
+EpochDomain::EpochDomain (size_t readers) : _readers(readers) {
+    _epoch = 0;
+
+    for (struct reader &r : _readers) {
+        r.epoch = INACTIVE;
+    }
+}
+
+void EpochDomain::Enter (size_t reader) {
+    // seq_cst store: either writer advancing the epoch sees us, or we see
+    // everything it unlinked before.
+    _readers[reader].epoch.store(_epoch.load(std::memory_order_acquire));
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void EpochDomain::Leave (size_t reader) {
+    _readers[reader].epoch.store(INACTIVE, std::memory_order_release);
+}
+
+uint64_t EpochDomain::Current () const {
+    return _epoch.load(std::memory_order_acquire);
+}
+
+bool EpochDomain::Reclaimable (uint64_t tag) {
+    uint64_t epoch = _epoch.load(std::memory_order_acquire);
+    if (epoch >= tag + 2) return true;
+
+    // epoch can move on once every active reader has entered at current
+    // epoch. a record retired at tag is safe two epochs later: readers that
+    // entered before it was unlinked are gone by then.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (const struct reader &r : _readers) {
+        uint64_t e = r.epoch.load(std::memory_order_acquire);
+        if (e != INACTIVE && e != epoch) return false;
+    }
+
+    _epoch.compare_exchange_strong(epoch, epoch + 1);
+
+    return _epoch.load(std::memory_order_acquire) >= tag + 2;
+}
+
+EpochGuard::EpochGuard (EpochDomain &domain, size_t reader) : _domain(domain) {
+    _reader = reader;
+    _domain.Enter(_reader);
+}
+
+EpochGuard::~EpochGuard () {
+    _domain.Leave(_reader);
+}
+
+}
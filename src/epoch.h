@@ -0,0 +1,101 @@
+#ifndef DIST_EPOCH_H
+#define DIST_EPOCH_H
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <utility>
+
+namespace distributor {
+
+// EpochDomain: epoch based reclamation. Readers on other threads wrap their
+// accesses to shared records in Enter()/Leave(). A writer that unlinks a
+// record retires it (RetireList) instead of freeing it, and the record is
+// freed once every reader that might have seen it has left. Readers never
+// block writers, and writers never wait for readers.
+class EpochDomain {
+public:
+    // readers: number of reader slots, one per reading thread.
+    EpochDomain (size_t readers);
+
+    // (reader) Enter critical section. Records found inside stay valid until
+    // Leave().
+    void Enter (size_t reader);
+
+    // (reader) Leave critical section.
+    void Leave (size_t reader);
+
+    // (writer) Get current epoch, to tag a record retired now.
+    uint64_t Current () const;
+
+    // (writer) Check if records retired at epoch tag can be freed, try to
+    // advance the epoch if not.
+    bool Reclaimable (uint64_t tag);
+
+private:
+    static const uint64_t INACTIVE = ~0ULL;
+
+    // one cache line per reader.
+    struct reader {
+        std::atomic<uint64_t> epoch;
+        uint8_t pad[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    std::atomic<uint64_t> _epoch;
+    std::vector<struct reader> _readers;
+};
+
+// EpochGuard: critical section of a reader for the lifetime of the guard.
+class EpochGuard {
+public:
+    EpochGuard (EpochDomain &domain, size_t reader);
+    ~EpochGuard ();
+
+private:
+    EpochDomain &_domain;
+    size_t _reader;
+};
+
+// RetireList: records retired by one writer, waiting to be freed.
+template <typename T>
+class RetireList {
+public:
+    RetireList (EpochDomain &domain) : _domain(domain) {}
+
+    ~RetireList () {
+        for (std::pair<uint64_t, T *> &r : _list) delete r.second;
+    }
+
+    // Retire a record unlinked from shared structures.
+    void Retire (T *record) {
+        _list.push_back(std::make_pair(_domain.Current(), record));
+    }
+
+    // Free records no reader can hold anymore. Return number of records
+    // freed.
+    size_t Collect () {
+        size_t n = 0;
+
+        // tags only grow, so stop at first record still in use.
+        while (!_list.empty() && _domain.Reclaimable(_list.front().first)) {
+            delete _list.front().second;
+            _list.pop_front();
+            n++;
+        }
+
+        return n;
+    }
+
+    bool Empty () const {
+        return _list.empty();
+    }
+
+private:
+    EpochDomain &_domain;
+    std::deque<std::pair<uint64_t, T *>> _list;
+};
+
+}
+
+#endif // DIST_EPOCH_H
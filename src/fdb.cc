@@ -1,145 +1,637 @@
 #include "fdb.h"
 #include "vars.h"
 #include "log.h"
+#include "clock.h"
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// entries per control group.
+#define FDB_GROUP 16
+
+// control tags. tags of entries in use are 0 - 0x7f.
+#define FDB_EMPTY 0x80
+#define FDB_DELETED 0xfe
+
+// end of a port list.
+#define FDB_NIL 0xffffffffU
 
 namespace distributor {
 
-FdbKey::FdbKey() {}
+// bit i set if tag i of group equals tag.
+static inline uint32_t group_match (const uint8_t *group, uint8_t tag) {
+#ifdef __SSE2__
+    __m128i ctrl = _mm_loadu_si128((const __m128i *) group);
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char) tag)));
+#else
+    uint32_t bits = 0;
+    for (int i = 0; i < FDB_GROUP; i++) bits |= (uint32_t) (group[i] == tag) << i;
+    return bits;
+#endif
+}
+
+// bit i set if entry i of group is not in use (empty or deleted).
+static inline uint32_t group_free (const uint8_t *group) {
+#ifdef __SSE2__
+    return (uint32_t) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) group));
+#else
+    uint32_t bits = 0;
+    for (int i = 0; i < FDB_GROUP; i++) bits |= (uint32_t) (group[i] >> 7) << i;
+    return bits;
+#endif
+}
 
-FdbKey::FdbKey (const struct ether_addr &addr) {
-    memcpy(&_address, &addr, sizeof(struct ether_addr));
-    _hash = 0;
-    ssize_t sz_diff = sizeof(size_t) - sizeof(struct ether_addr);
-    if (sz_diff > 0) {
-        memcpy(((uint8_t *) &_hash) + sz_diff, &addr, sizeof(struct ether_addr));
-    } else {
-        memcpy(&_hash, ((uint8_t *) &addr) + sz_diff, sizeof(size_t));
+Fdb::Fdb (size_t max_port, size_t max_net, size_t max_total) {
+    _max_port = max_port;
+    _max_net = max_net;
+    _max_total = max_total;
+    _ctrl = nullptr;
+    _entries = nullptr;
+    _seen = nullptr;
+    _links = nullptr;
+    _capacity = 0;
+    _size = 0;
+    _table_size = 0;
+    _used = 0;
+    _largest = 0;
+    _age_pos = 0;
+    _generation = 0;
+    Rehash(FDB_GROUP);
+}
+
+Fdb::~Fdb () {
+    delete[] _ctrl;
+    delete[] _entries;
+    delete[] _seen;
+    delete[] _links;
+}
+
+uint64_t Fdb::Pack (const struct ether_addr &addr) {
+    uint64_t mac = 0;
+    memcpy(&mac, &addr, sizeof(struct ether_addr));
+    return mac;
+}
+
+struct ether_addr Fdb::Unpack (uint64_t mac) {
+    struct ether_addr addr;
+    memcpy(&addr, &mac, sizeof(struct ether_addr));
+    return addr;
+}
+
+uint64_t Fdb::Hash (net_index_t net, uint64_t mac) {
+    // spread network over all bits, then murmur3 finalizer: tag (low 7 bits)
+    // and group (the rest) both depend on every bit of network and address.
+    uint64_t h = mac ^ ((uint64_t) net * 0x9E3779B97F4A7C15ULL);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+ssize_t Fdb::FindSmall (const struct net_state &n, uint64_t mac) {
+    for (uint32_t i = 0; i < n.size; i++) {
+        if (n.small[i].mac == mac) return (ssize_t) i;
     }
-    log_logic("Hash(%s) = %zu\n", ether_ntoa(&addr), _hash);
+
+    return -1;
 }
 
-const struct ether_addr* FdbKey::Ptr() const {
-    return &_address;
+void Fdb::EraseSmall (net_index_t net, size_t index) {
+    struct net_state &n = _nets[net];
+    _lists[n.small[index].port].size--;
+    memmove(&n.small[index], &n.small[index + 1], (n.size - index - 1) * sizeof(struct small_entry));
+    n.size--;
+    n.generation = ++_generation;
+    _size--;
 }
 
-const struct ether_addr& FdbKey::Ref() const {
-    return _address;
+void Fdb::Spill (net_index_t net) {
+    struct net_state &n = _nets[net];
+    log_debug("Fdb%" PRInet ": Spilling %" PRIu32 " entries to table.\n", n.net, n.size);
+
+    // oldest first, so port lists stay newest first.
+    for (uint32_t i = 0; i < n.size; i++) Place(net, n.small[i].mac, n.small[i].port, n.small[i].seen);
+    n.spilled = true;
 }
 
-size_t FdbKey::Hash() const {
-    return _hash;
+bool Fdb::MakeRoom (net_index_t net, port_index_t port) {
+    struct net_state &n = _nets[net];
+
+    // port at its limit only replaces its own entries.
+    if (PortSize(port) >= _max_port) {
+        log_debug("Fdb%" PRInet ": Port %" PRIpidx " full, evicting its oldest entry.\n", n.net, port);
+        return Evict(port);
+    }
+
+    // network full: take from its largest port, found again if it has left
+    // (another port has entries, the network is full).
+    if (n.size >= _max_net) {
+        if (PortSize(n.largest) == 0 || _lists[n.largest].net != net) n.largest = Largest(net, false);
+        port_index_t victim = n.largest;
+
+        log_debug("Fdb%" PRInet ": Full, evicting oldest entry of port %" PRIpidx ".\n", n.net, victim);
+        return Evict(victim);
+    }
+
+    // fdb full: same, over all networks.
+    if (_size >= _max_total) {
+        if (PortSize(_largest) == 0) _largest = Largest(net, true);
+        port_index_t victim = _largest;
+
+        log_debug("Fdb: Full, evicting oldest entry of port %" PRIpidx ".\n", victim);
+        return Evict(victim);
+    }
+
+    return true;
 }
 
-bool FdbKey::operator== (const FdbKey &other) const {
-    return memcmp(&(other._address), &_address, sizeof(struct ether_addr)) == 0;
+port_index_t Fdb::Largest (net_index_t net, bool any_net) const {
+    port_index_t largest = 0;
+    size_t size = 0;
+
+    for (size_t p = 0; p < _lists.size(); p++) {
+        const struct port_list &list = _lists[p];
+        if (list.size <= size || (!any_net && list.net != net)) continue;
+        largest = (port_index_t) p;
+        size = list.size;
+    }
+
+    return largest;
 }
 
-size_t FdbKeyHasher::operator() (const FdbKey &key) const {
-    return key.Hash();
+void Fdb::Grew (net_index_t net, port_index_t port) {
+    struct net_state &n = _nets[net];
+    size_t size = _lists[port].size;
+
+    // a stale hint (port gone, or now in another network) is replaced.
+    if (size > PortSize(n.largest) || _lists[n.largest].net != net) n.largest = port;
+    if (size > PortSize(_largest)) _largest = port;
 }
 
-FdbValue::FdbValue (port_t port) : _port (port) {
-    log_logic("FdbValue created for port %" PRIport "\n", port);
-    _last_seen = time (NULL);
+bool Fdb::Evict (port_index_t port) {
+    if (PortSize(port) == 0) return false;
+
+    net_index_t net = _lists[port].net;
+    struct net_state &n = _nets[net];
+
+    if (n.spilled) {
+        size_t oldest = _lists[port].tail;
+        _counters.evicted.Add();
+        Unlink(oldest);
+        Erase(oldest);
+        return true;
+    }
+
+    // inline entries are oldest first.
+    for (uint32_t i = 0; i < n.size; i++) {
+        if (n.small[i].port != port) continue;
+        _counters.evicted.Add();
+        EraseSmall(net, i);
+        return true;
+    }
+
+    return false;
+}
+
+ssize_t Fdb::Find (net_index_t net, uint64_t mac, uint64_t hash) const {
+    uint8_t tag = hash & 0x7f;
+    size_t mask = _capacity / FDB_GROUP - 1;
+    size_t group = (hash >> 7) & mask;
+
+    // triangular probing over groups visits every group. at most 7/8 of
+    // entries are used, so probing ends at a group with an empty entry.
+    for (size_t step = 1;; step++) {
+        const uint8_t *ctrl = _ctrl + group * FDB_GROUP;
+
+        for (uint32_t m = group_match(ctrl, tag); m != 0; m &= m - 1) {
+            size_t i = group * FDB_GROUP + __builtin_ctz(m);
+            if (_entries[i].mac == mac && _entries[i].net == net) return (ssize_t) i;
+        }
+
+        if (group_match(ctrl, FDB_EMPTY) != 0) return -1;
+
+        group = (group + step) & mask;
+    }
 }
 
-void FdbValue::Refresh () {
-    log_logic("FdbValue refreshed for port %" PRIport "\n", _port);
-    _last_seen = time (NULL);
+void Fdb::Erase (size_t index) {
+    uint8_t *ctrl = _ctrl + index / FDB_GROUP * FDB_GROUP;
+
+    // a group that was never full did not make any probe go on, so the entry
+    // can become empty again.
+    if (group_match(ctrl, FDB_EMPTY) != 0) {
+        _ctrl[index] = FDB_EMPTY;
+        _used--;
+    } else _ctrl[index] = FDB_DELETED;
+
+    _lists[_entries[index].port].size--;
+
+    // network goes back inline with its last entry.
+    struct net_state &n = _nets[_entries[index].net];
+    if (--n.size == 0) n.spilled = false;
+    n.generation = ++_generation;
+
+    _size--;
+    _table_size--;
 }
 
-time_t FdbValue::GetAge () const {
-    return time (NULL) - _last_seen;
+size_t Fdb::Place (net_index_t net, uint64_t mac, port_index_t port, uint32_t seen) {
+    if ((_used + 1) * 8 > _capacity * 7) {
+        // grow if mostly entries, otherwise just drop deleted ones.
+        Rehash(_table_size * 16 > _capacity * 7 ? _capacity * 2 : _capacity);
+    }
+
+    // first free entry on probe path of mac.
+    uint64_t hash = Hash(net, mac);
+    size_t mask = _capacity / FDB_GROUP - 1;
+    size_t group = (hash >> 7) & mask;
+    uint32_t m;
+
+    for (size_t step = 1; (m = group_free(_ctrl + group * FDB_GROUP)) == 0; step++) {
+        group = (group + step) & mask;
+    }
+
+    size_t j = group * FDB_GROUP + __builtin_ctz(m);
+    if (_ctrl[j] == FDB_EMPTY) _used++;
+    _ctrl[j] = hash & 0x7f;
+    _entries[j].mac = mac;
+    _entries[j].net = net;
+    _entries[j].port = port;
+    _seen[j] = seen;
+    Link(j);
+    _table_size++;
+
+    return j;
 }
 
-port_t FdbValue::GetPort () const {
-    return _port;
+Fdb::port_list* Fdb::List (port_index_t port) {
+    if (port >= _lists.size() || _lists[port].head == FDB_NIL) return nullptr;
+    return &_lists[port];
 }
 
-void FdbValue::SetPort (port_t port) {
-    _port = port;
+Fdb::port_list& Fdb::Ports (port_index_t port) {
+    if (port >= _lists.size()) {
+        struct port_list empty;
+        empty.head = empty.tail = FDB_NIL;
+        empty.size = 0;
+        empty.net = 0;
+        _lists.resize(port + 1, empty);
+    }
+
+    return _lists[port];
 }
 
-Fdb::Fdb(net_t network) {
-    _network = network;
+size_t Fdb::PortSize (port_index_t port) const {
+    return port < _lists.size() ? _lists[port].size : 0;
 }
 
-port_t Fdb::Lookup (const struct ether_addr &addr) {
-    log_debug("Fdb%" PRInet ": Looking up: %s\n", _network, ether_ntoa(&addr));
-    fdb_t::const_iterator it = _fdb.find(FdbKey(addr));
+void Fdb::Link (size_t index) {
+    struct port_list &list = Ports(_entries[index].port);
 
-    // not found?
-    if (it == _fdb.end()) {
-        log_debug("Fdb%" PRInet ": Not found: %s\n", _network, ether_ntoa(&addr));
-        return 0;
+    _links[index].prev = FDB_NIL;
+    _links[index].next = list.head;
+    if (list.head != FDB_NIL) _links[list.head].prev = index;
+    else list.tail = index;
+    list.head = index;
+}
+
+void Fdb::Unlink (size_t index) {
+    struct port_list &list = _lists[_entries[index].port];
+    uint32_t prev = _links[index].prev;
+    uint32_t next = _links[index].next;
+
+    if (prev != FDB_NIL) _links[prev].next = next;
+    else list.head = next;
+
+    if (next != FDB_NIL) _links[next].prev = prev;
+    else list.tail = prev;
+}
+
+void Fdb::Rehash (size_t capacity) {
+    uint8_t *old_ctrl = _ctrl;
+    struct entry *old_entries = _entries;
+    uint32_t *old_seen = _seen;
+    struct link *old_links = _links;
+
+    _ctrl = new uint8_t[capacity];
+    _entries = new struct entry[capacity];
+    _seen = new uint32_t[capacity];
+    _links = new struct link[capacity];
+
+    // ageing goes on at the same share of the table, or the same network.
+    if (_age_pos < _capacity) _age_pos = _age_pos * capacity / _capacity;
+    else if (_capacity != 0) _age_pos = _age_pos - _capacity + capacity;
+
+    _capacity = capacity;
+    _used = _table_size;
+    memset(_ctrl, FDB_EMPTY, capacity);
+
+    size_t mask = capacity / FDB_GROUP - 1;
+
+    // move port by port, oldest first, so port lists keep their order.
+    for (struct port_list &list : _lists) {
+        uint32_t i = list.tail;
+        list.head = list.tail = FDB_NIL;
+
+        for (; i != FDB_NIL; i = old_links[i].prev) {
+            uint64_t hash = Hash(old_entries[i].net, old_entries[i].mac);
+            size_t group = (hash >> 7) & mask;
+            uint32_t m;
+
+            for (size_t step = 1; (m = group_free(_ctrl + group * FDB_GROUP)) == 0; step++) {
+                group = (group + step) & mask;
+            }
+
+            size_t j = group * FDB_GROUP + __builtin_ctz(m);
+            _ctrl[j] = hash & 0x7f;
+            _entries[j] = old_entries[i];
+            _seen[j] = old_seen[i];
+            Link(j);
+        }
     }
 
-    // aged?
-    if ((*it).second.GetAge() > DIST_FDB_AGEING) {
-        log_notice("Fdb%" PRInet ": Aged: %s\n", _network, ether_ntoa(&addr));
-        _fdb.erase(it);
-        return 0;
+    delete[] old_ctrl;
+    delete[] old_entries;
+    delete[] old_seen;
+    delete[] old_links;
+}
+
+net_index_t Fdb::Open (net_t net) {
+    net_index_t index;
+
+    if (_free_nets.empty()) {
+        index = (net_index_t) _nets.size();
+        _nets.resize(_nets.size() + 1);
+    } else {
+        index = _free_nets.back();
+        _free_nets.pop_back();
+    }
+
+    struct net_state &n = _nets[index];
+    n.net = net;
+    n.size = 0;
+    n.largest = 0;
+    n.spilled = false;
+    n.generation = ++_generation;
+
+    return index;
+}
+
+void Fdb::Close (net_index_t net) {
+    if (_nets[net].size != 0) {
+        log_error("Fdb%" PRInet ": Closed with %" PRIu32 " entries left.\n", _nets[net].net, _nets[net].size);
     }
 
-    port_t port = (*it).second.GetPort();
+    _free_nets.push_back(net);
+}
+
+port_index_t Fdb::Lookup (net_index_t net, const struct ether_addr &addr) const {
+    const struct net_state &n = _nets[net];
+    log_debug("Fdb%" PRInet ": Looking up: %s\n", n.net, ether_ntoa(&addr));
+    uint64_t mac = Pack(addr);
+    port_index_t port = 0;
 
-    log_debug("Fdb%" PRInet ": Found: %s, on port %" PRIport "\n", _network, ether_ntoa(&addr), port);
+    if (!n.spilled) {
+        ssize_t i = FindSmall(n, mac);
+        if (i >= 0) port = n.small[i].port;
+    } else {
+        ssize_t i = Find(net, mac, Hash(net, mac));
+        if (i >= 0) port = _entries[i].port;
+    }
+
+    // not found?
+    if (port == 0) {
+        log_debug("Fdb%" PRInet ": Not found: %s\n", n.net, ether_ntoa(&addr));
+        return 0;
+    }
+
+    log_debug("Fdb%" PRInet ": Found: %s, on port %" PRIpidx "\n", n.net, ether_ntoa(&addr), port);
     return port;
 }
 
-bool Fdb::Insert (port_t port, const struct ether_addr &addr) {
-    log_debug("Fdb%" PRInet ": Inserting: %s@%" PRIport "\n", _network, ether_ntoa(&addr), port);
+bool Fdb::Insert (net_index_t net, port_index_t port, const struct ether_addr &addr) {
+    struct net_state &n = _nets[net];
+    log_debug("Fdb%" PRInet ": Inserting: %s@%" PRIpidx "\n", n.net, ether_ntoa(&addr), port);
+
+    uint64_t mac = Pack(addr);
+    uint32_t now = Clock::Now();
 
-    fdb_t::iterator it = _fdb.find(FdbKey(addr));
+    // port and last seen time of a known address, inline or in table.
+    port_index_t *known = nullptr;
+    uint32_t *seen = nullptr;
+    ssize_t i = -1;
 
-    if (it != _fdb.end()) {
-        log_logic("Entry exists, skipping lock and update directly.\n");
-        it->second.Refresh();
-        it->second.SetPort(port);
-        log_debug("Fdb%" PRInet ": Refreshed: %s@%" PRIport "\n", _network, ether_ntoa(&addr), port);
+    if (!n.spilled) {
+        ssize_t s = FindSmall(n, mac);
+
+        if (s >= 0) {
+            known = &n.small[s].port;
+            seen = &n.small[s].seen;
+        }
+    } else {
+        i = Find(net, mac, Hash(net, mac));
+
+        if (i >= 0) {
+            known = &_entries[i].port;
+            seen = &_seen[i];
+        }
+    }
+
+    if (known != nullptr) {
+        // port at its limit replaces its oldest entry, which may move entries
+        // around: look the address up again.
+        if (*known != port && PortSize(port) >= _max_port) {
+            log_debug("Fdb%" PRInet ": Port %" PRIpidx " full, evicting its oldest entry.\n", n.net, port);
+            Evict(port);
+            return Insert(net, port, addr);
+        }
+
+        if (*known != port) {
+            if (i >= 0) Unlink(i);
+            _lists[*known].size--;
+            Ports(port).size++;
+            _lists[port].net = net;
+            *known = port;
+            if (i >= 0) Link(i);
+            *seen = now;
+            n.generation = ++_generation;
+            Grew(net, port);
+            _counters.moved.Add();
+            log_info("Fdb%" PRInet ": Moved: %s@%" PRIpidx "\n", n.net, ether_ntoa(&addr), port);
+            return false;
+        }
+
+        // known address on same port: nothing written but a coarse refresh.
+        if (now - *seen >= DIST_FDB_REFRESH) *seen = now;
+
+        log_debug("Fdb%" PRInet ": Refreshed: %s@%" PRIpidx "\n", n.net, ether_ntoa(&addr), port);
         return false;
     }
 
-    std::pair<fdb_t::iterator, bool> rslt = _fdb.insert(std::make_pair(FdbKey(addr), FdbValue(port)));
-    log_info("Fdb%" PRInet ": Inserted: %s@%" PRIport "\n", _network, ether_ntoa(&addr), port);
-    return rslt.second;
+    if (!MakeRoom(net, port)) {
+        _counters.refused.Add();
+        log_debug("Fdb%" PRInet ": Full, not learning: %s@%" PRIpidx "\n", n.net, ether_ntoa(&addr), port);
+        return false;
+    }
+
+    if (!n.spilled && n.size == DIST_FDB_SMALL) Spill(net);
+
+    if (n.spilled) Place(net, mac, port, now);
+    else {
+        struct small_entry &e = n.small[n.size];
+        e.mac = mac;
+        e.port = port;
+        e.seen = now;
+    }
+
+    n.size++;
+    _size++;
+
+    struct port_list &list = Ports(port);
+    list.size++;
+    list.net = net;
+    Grew(net, port);
+
+    _counters.learned.Add();
+
+    log_info("Fdb%" PRInet ": Inserted: %s@%" PRIpidx "\n", n.net, ether_ntoa(&addr), port);
+    return true;
 }
 
-bool Fdb::Delete (const struct ether_addr &addr) {
-    log_debug("Fdb%" PRInet ": Deleting: %s\n", _network, ether_ntoa(&addr));
-    fdb_t::const_iterator it = _fdb.find(FdbKey(addr));
+bool Fdb::Delete (net_index_t net, const struct ether_addr &addr) {
+    const struct net_state &n = _nets[net];
+    log_debug("Fdb%" PRInet ": Deleting: %s\n", n.net, ether_ntoa(&addr));
+    uint64_t mac = Pack(addr);
+    ssize_t i = n.spilled ? Find(net, mac, Hash(net, mac)) : FindSmall(n, mac);
 
     // not found
-    if (it == _fdb.end()) {
-        log_debug("Fdb%" PRInet ": Not found: %s\n", _network, ether_ntoa(&addr));
+    if (i < 0) {
+        log_debug("Fdb%" PRInet ": Not found: %s\n", n.net, ether_ntoa(&addr));
         return false;
     }
 
-    log_info("Fdb%" PRInet ": Deleted: %s\n", _network, ether_ntoa(&addr));
-    _fdb.erase(it);
+    log_info("Fdb%" PRInet ": Deleted: %s\n", n.net, ether_ntoa(&addr));
+
+    if (n.spilled) {
+        Unlink(i);
+        Erase(i);
+    } else EraseSmall(net, i);
+
     return true;
 }
 
-int Fdb::Discard (port_t port) {
-    log_debug("Fdb%" PRInet ": Discarding port %" PRIport "...\n", _network, port);
-
-    fdb_t::const_iterator it = _fdb.begin();
+int Fdb::Discard (net_index_t net, port_index_t port) {
+    log_debug("Fdb: Discarding port %" PRIpidx "...\n", port);
 
+    struct net_state &n = _nets[net];
     int removed = 0;
 
-    while (it != _fdb.end()) {
-        if ((*it).second.GetPort() == port) {
+    if (!n.spilled) {
+        for (size_t i = n.size; i-- > 0;) {
+            if (n.small[i].port != port) continue;
+            EraseSmall(net, i);
             removed++;
-            log_debug("Fdb%" PRInet ": Remove: %s@%" PRIport "\n", _network, ether_ntoa((*it).first.Ptr()), port);
-            it = _fdb.erase(it);
-        } else it++;
+        }
+    } else {
+        struct port_list *list = List(port);
+
+        if (list != nullptr) {
+            // whole list goes, no need to unlink entries one by one.
+            for (uint32_t i = list->head; i != FDB_NIL; i = _links[i].next) {
+                removed++;
+#ifdef DIST_DEBUG
+                struct ether_addr addr = Unpack(_entries[i].mac);
+                log_debug("Fdb%" PRInet ": Remove: %s@%" PRIpidx "\n", n.net, ether_ntoa(&addr), port);
+#endif
+                Erase(i);
+            }
+
+            list->head = list->tail = FDB_NIL;
+        }
     }
 
-    log_info("Fdb%" PRInet ": Discared port %" PRIport ". %d ports removed.\n", _network, port, removed);
+    log_info("Fdb: Discared port %" PRIpidx ". %d ports removed.\n", port, removed);
 
     return removed;
 }
 
+bool Fdb::Age (uint32_t now, size_t &budget) {
+    for (; _age_pos < _capacity + _nets.size(); _age_pos++) {
+        if (budget == 0) return false;
+        budget--;
+
+        // table entries first.
+        if (_age_pos < _capacity) {
+            size_t i = _age_pos;
+            if ((_ctrl[i] & 0x80) || now - _seen[i] <= DIST_FDB_AGEING) continue;
+
+#ifndef DIST_SILENCE
+            struct ether_addr addr = Unpack(_entries[i].mac);
+            log_notice("Fdb%" PRInet ": Aged: %s\n", _nets[_entries[i].net].net, ether_ntoa(&addr));
+#endif
+            Unlink(i);
+            Erase(i);
+            _counters.aged.Add();
+            continue;
+        }
+
+        // then inline entries of networks, one network at a time.
+        net_index_t net = (net_index_t) (_age_pos - _capacity);
+        struct net_state &n = _nets[net];
+        if (n.spilled) continue;
+
+        for (size_t i = n.size; i-- > 0;) {
+            if (now - n.small[i].seen <= DIST_FDB_AGEING) continue;
+
+#ifndef DIST_SILENCE
+            struct ether_addr addr = Unpack(n.small[i].mac);
+            log_notice("Fdb%" PRInet ": Aged: %s\n", n.net, ether_ntoa(&addr));
+#endif
+            EraseSmall(net, i);
+            _counters.aged.Add();
+        }
+    }
+
+    _age_pos = 0;
+
+    // mostly empty after mass removal, give memory back.
+    if (_capacity > FDB_GROUP && _table_size * 16 < _capacity) {
+        size_t capacity = FDB_GROUP;
+        while (capacity < _table_size * 4) capacity *= 2;
+        Rehash(capacity);
+    }
+
+    return true;
+}
+
+void Fdb::Clear () {
+    _size = 0;
+    _table_size = 0;
+    _lists.clear();
+    _nets.clear();
+    _free_nets.clear();
+    _largest = 0;
+    _age_pos = 0;
+    Rehash(FDB_GROUP);
+}
+
+size_t Fdb::Size () const {
+    return _size;
+}
 
-}
\ No newline at end of file
+size_t Fdb::NetSize (net_index_t net) const {
+    return _nets[net].size;
+}
+
+const struct Fdb::fdb_counters& Fdb::Counters () const {
+    return _counters;
+}
+
+uint64_t Fdb::Generation (net_index_t net) const {
+    return _nets[net].generation;
+}
+
+}
@@ -1,81 +1,252 @@
 #ifndef DIST_FDB_H
 #define DIST_FDB_H
 #include "types.h"
+#include "stats.h"
+#include "vars.h"
 #include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
 #include <net/ethernet.h>
 #ifdef __linux__
 #include <netinet/ether.h>
 #endif
-#include <unordered_map>
+#include <vector>
 
 namespace distributor {
 
-// key type for unordered_map to map ethernet address to fdb entries.
-class FdbKey {
+// fdb: (network, ethernet address) -> port index (see Switch), for every
+// network of a switch.
+//
+// Networks are added with Open(), which gives them a dense index, and every
+// other call takes that index. What fdb knows of a network (number of
+// entries, and the entries themselves while there are at most
+// DIST_FDB_SMALL of them, oldest first) is kept in an array by network
+// index, so a network with a few hosts never touches the shared table: a
+// lookup reads one record of the array.
+//
+// Bigger networks spill to one flat open addressing table shared by all
+// networks, keyed on (network index, address). Entries are 16 bytes (MAC
+// packed in 48 bits, network index, port index), four to a cache line, with
+// no per-entry allocation. Every entry also has a one byte control tag (7
+// bits of its hash, or empty/deleted) kept in a separate array, probed 16 at
+// a time (SSE2 where available): most lookups read one group of tags and one
+// entry. Last seen times are kept apart too, so refreshing an entry does not
+// write to the lines lookups read.
+//
+// Fdb is read-mostly: inserting a known address on the same port writes
+// nothing but its last seen time, at most once per DIST_FDB_REFRESH seconds.
+// Only new and moved addresses change the table.
+//
+// Entries of every port in the table are also chained in a doubly linked
+// list (by entry index, kept apart from entries), so discarding a port only
+// visits its own entries.
+//
+// Aged entries are removed by Age(), called a little at a time. A port at
+// its own limit replaces its oldest entry. When a network (or the whole fdb)
+// is full, a new entry replaces the oldest entry of its largest port, so a
+// port spraying random source addresses evicts its own entries and a new
+// port is still learned. The largest port is the one that last grew past
+// the previous largest, which is exact enough for a sprayer: it grows all
+// the time. When it has left, it is found again by scanning ports.
+class Fdb {
 public:
-    FdbKey ();
-    FdbKey (const struct ether_addr &addr);
-    const struct ether_addr* Ptr() const;
-    const struct ether_addr& Ref() const;
-    size_t Hash() const;
-    bool operator== (const FdbKey &other) const;
+    // learning events, and entries removed other than by Delete()/Discard().
+    struct fdb_counters {
+        Counter learned;
+        Counter moved;
+        Counter evicted;
+        Counter aged;
+        Counter refused;
+    };
 
-private:
-    size_t _hash;
-    struct ether_addr _address;
-};
+    // max_port: max entries of one port, max_net: max entries in one
+    // network, max_total: max entries in all networks.
+    Fdb (size_t max_port, size_t max_net, size_t max_total);
+    Fdb (const Fdb &) = delete;
+    Fdb& operator= (const Fdb &) = delete;
+    ~Fdb ();
 
-// fdb value
-class FdbValue {
-public:
-    FdbValue (port_t port);
-    void Refresh ();
-    time_t GetAge () const;
-    port_t GetPort () const;
-    void SetPort (port_t port);
+    // Add a network, return its index. Indexes of closed networks are
+    // reused.
+    net_index_t Open (net_t net);
 
-private:
-    port_t _port;
-    time_t _last_seen;
-};
+    // Remove a network, its entries must have been discarded.
+    void Close (net_index_t net);
 
-// hashing function for fdb key
-class FdbKeyHasher {
-public:
-    size_t operator() (const FdbKey &key) const;
-};
+    // Look up an address in network, return 0 if not found.
+    port_index_t Lookup (net_index_t net, const struct ether_addr &addr) const;
 
-// fdb
-class Fdb {
-public:
-    typedef std::unordered_map<FdbKey, FdbValue, FdbKeyHasher> fdb_t;
+    // Insert a forwarding database entry for port in network, return true if
+    // new entry created, return false if old entry refreshed or moved, or fdb
+    // is full.
+    bool Insert (net_index_t net, port_index_t port, const struct ether_addr &addr);
+
+    // Remove a forwarding database entry.
+    bool Delete (net_index_t net, const struct ether_addr &addr);
+
+    // Remove all forwarding database entries for port in network, return
+    // number of entries removed.
+    int Discard (net_index_t net, port_index_t port);
+
+    // Remove entries not seen for DIST_FDB_AGEING seconds at time now,
+    // visiting at most budget entries (budget is decreased). Next call goes
+    // on from there. Return true if a pass over the whole fdb is complete.
+    bool Age (uint32_t now, size_t &budget);
+
+    // Remove all entries.
+    void Clear ();
 
-    Fdb (net_t network);
+    // Get number of entries.
+    size_t Size () const;
 
-    // Look up an address in fdb, return 0 if not found. (entry will be remove 
-    // if aged, and 0 will be returned)
-    port_t Lookup (const struct ether_addr &addr);
+    // Get number of entries in network.
+    size_t NetSize (net_index_t net) const;
 
-    // Insert a forwarding database entry for port, return true if new entry
-    // created, return false if old entry updated.
-    bool Insert (port_t port, const struct ether_addr &addr);
+    // Get counters.
+    const struct fdb_counters& Counters () const;
 
-    // Remove a forwarding database entry for port.
-    bool Delete (const struct ether_addr &addr);
+    // Get generation of network. It changes every time an entry of the
+    // network is removed or moved to another port, and is never 0. A value
+    // is never given twice, to any network (even to a reused index).
+    uint64_t Generation (net_index_t net) const;
 
-    // Remove all forwarding database entries for port, return number of entries
-    // removed.
-    int Discard (port_t port);
+    // Pack an ethernet address in the low 48 bits.
+    static uint64_t Pack (const struct ether_addr &addr);
 
 private:
-    // which network is this fdb for? (for logging only)
-    net_t _network;
+    struct entry {
+        uint64_t mac;
+        net_index_t net;
+        port_index_t port;
+    };
+
+    // entry of a network that has not spilled.
+    struct small_entry {
+        uint64_t mac;
+        port_index_t port;
+        uint32_t seen;
+    };
+
+    // a network: its id (for logging), number of entries, its largest port,
+    // its generation, and its entries (oldest first) until it spills to the
+    // table.
+    struct net_state {
+        net_t net;
+        uint32_t size;
+        port_index_t largest;
+        bool spilled;
+        uint64_t generation;
+        struct small_entry small[DIST_FDB_SMALL];
+    };
+
+    // per-port list links of an entry.
+    struct link {
+        uint32_t prev;
+        uint32_t next;
+    };
+
+    // entries of a port in table (newest first), number of entries of the
+    // port, inline or in table, and their network.
+    struct port_list {
+        uint32_t head;
+        uint32_t tail;
+        uint32_t size;
+        net_index_t net;
+    };
+
+    // Get an ethernet address back from Pack() value.
+    static struct ether_addr Unpack (uint64_t mac);
+
+    static uint64_t Hash (net_index_t net, uint64_t mac);
+
+    // Find inline entry of mac in network, -1 if not found.
+    static ssize_t FindSmall (const struct net_state &n, uint64_t mac);
+
+    // Remove inline entry at index of network.
+    void EraseSmall (net_index_t net, size_t index);
+
+    // Move inline entries of network to the table.
+    void Spill (net_index_t net);
+
+    // Make room for a new entry of port in network if a limit is reached.
+    // Return false if there is no room.
+    bool MakeRoom (net_index_t net, port_index_t port);
+
+    // Find the port with most entries in network (or in any network),
+    // scanning every port. 0 if no port has entries.
+    port_index_t Largest (net_index_t net, bool any_net) const;
+
+    // Update largest port hints after port got an entry in network.
+    void Grew (net_index_t net, port_index_t port);
+
+    // Remove oldest entry of port, return false if port has no entries.
+    bool Evict (port_index_t port);
+
+    // Find entry index of (net, mac), -1 if not found.
+    ssize_t Find (net_index_t net, uint64_t mac, uint64_t hash) const;
+
+    // Put a new entry in the table, return its index.
+    size_t Place (net_index_t net, uint64_t mac, port_index_t port, uint32_t seen);
+
+    // Mark entry at index as removed, without unlinking it.
+    void Erase (size_t index);
+
+    // Add entry at index to the list of its port.
+    void Link (size_t index);
+
+    // Remove entry at index from the list of its port.
+    void Unlink (size_t index);
+
+    // Get list of port, nullptr if port has no entries in table.
+    struct port_list* List (port_index_t port);
+
+    // Get list of port, created if missing.
+    struct port_list& Ports (port_index_t port);
+
+    // Get number of entries of port.
+    size_t PortSize (port_index_t port) const;
+
+    // Move entries to new arrays of capacity entries.
+    void Rehash (size_t capacity);
+
+    size_t _max_port;
+    size_t _max_net;
+    size_t _max_total;
+
+    // control tags, entries, their last seen times and port list links.
+    // capacity is a power of two, at least one group.
+    uint8_t *_ctrl;
+    struct entry *_entries;
+    uint32_t *_seen;
+    struct link *_links;
+    size_t _capacity;
+
+    // number of entries (inline and in table), of entries in table, and of
+    // table entries plus deleted ones.
+    size_t _size;
+    size_t _table_size;
+    size_t _used;
+
+    // entries of every port in table, indexed by port index.
+    std::vector<struct port_list> _lists;
+
+    // networks by index, and indexes free for reuse.
+    std::vector<struct net_state> _nets;
+    std::vector<net_index_t> _free_nets;
+
+    // largest port of all networks.
+    port_index_t _largest;
+
+    // next position to visit in Age(): table entries, then networks. kept
+    // (scaled to new capacity) when table is rehashed.
+    size_t _age_pos;
 
-    // etheraddr to fdn entry mapping (fdb)
-    fdb_t _fdb;
+    // last generation given to a network.
+    uint64_t _generation;
 
+    struct fdb_counters _counters;
 };
 
 }
 
-#endif // DIST_FDB_H
\ No newline at end of file
+#endif // DIST_FDB_H
@@ -0,0 +1,73 @@
+#ifndef DIST_FLOW_CACHE_H
+#define DIST_FLOW_CACHE_H
+#include "types.h"
+#include <stddef.h>
+#include <stdint.h>
+
+namespace distributor {
+
+// FlowCache: last N (source, destination) address pairs forwarded as known
+// unicast from one port, with the destination port index found in FDB.
+//
+// A pair is only valid for the FDB generation of the port's network it was
+// found in (see Fdb::Generation()): generation changes whenever FDB removes
+// an entry of the network or moves one to another port, so a pair found
+// again in the same generation still maps to the same ports, and its source
+// is still learned on the port that owns the cache. Changes in other networks
+// leave the pair valid.
+template <size_t N>
+class FlowCache {
+public:
+    FlowCache () : _next(0) {
+        Clear();
+    }
+
+    // Find pair (addresses packed by Fdb::Pack()), return destination port
+    // index, or 0 if not cached in generation gen. seen is set to the time
+    // the pair was last refreshed in FDB.
+    port_index_t Find (uint64_t src, uint64_t dst, uint64_t gen, uint32_t *&seen) {
+        for (size_t i = 0; i < N; i++) {
+            struct flow &f = _flows[i];
+
+            if (f.dst == dst && f.src == src && f.gen == gen) {
+                seen = &f.seen;
+                return f.port;
+            }
+        }
+
+        return 0;
+    }
+
+    // Add pair, replacing the oldest one.
+    void Add (uint64_t src, uint64_t dst, uint64_t gen, port_index_t port, uint32_t seen) {
+        struct flow &f = _flows[_next];
+        f.src = src;
+        f.dst = dst;
+        f.gen = gen;
+        f.port = port;
+        f.seen = seen;
+        _next = (_next + 1) % N;
+    }
+
+    // Forget every pair.
+    void Clear () {
+        // generation 0 is never used by FDB.
+        for (size_t i = 0; i < N; i++) _flows[i].gen = 0;
+    }
+
+private:
+    struct flow {
+        uint64_t src;
+        uint64_t dst;
+        uint64_t gen;
+        port_index_t port;
+        uint32_t seen;
+    };
+
+    struct flow _flows[N];
+    uint32_t _next;
+};
+
+}
+
+#endif // DIST_FLOW_CACHE_H
@@ -0,0 +1,85 @@
+#ifndef DIST_HISTOGRAM_H
+#define DIST_HISTOGRAM_H
+#include "stats.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace distributor {
+
+// Histogram: log-linear (HDR style) histogram of values. Values below 16 have
+// a bucket each, every power of two above is split into 16 buckets, so a
+// value is known to within 1/16 (6.25%). Values of 2^40 and more share the
+// last bucket.
+//
+// Recorded by one thread (one Counter per bucket, no locks) and read by any:
+// readers add the buckets up with Merge() and get percentiles from the sum.
+class Histogram {
+public:
+    static const size_t SUB_BITS = 4;
+    static const size_t MAX_BITS = 40;
+    static const size_t BUCKETS = (1 << SUB_BITS) + (MAX_BITS - SUB_BITS) * (1 << SUB_BITS);
+
+    // Record a value.
+    void Record (uint64_t value) {
+        _buckets[Bucket(value)].Add();
+    }
+
+    // Add bucket counts to sum (resized to BUCKETS if needed).
+    void Merge (std::vector<uint64_t> &sum) const {
+        size_t n = BUCKETS;
+        if (sum.size() < n) sum.resize(n, 0);
+        for (size_t i = 0; i < n; i++) sum[i] += _buckets[i].Get();
+    }
+
+    // Get bucket of a value.
+    static size_t Bucket (uint64_t value) {
+        if (value < (1 << SUB_BITS)) return (size_t) value;
+        if (value >= (1ULL << MAX_BITS)) return BUCKETS - 1;
+
+        size_t exp = 63 - __builtin_clzll(value);
+        size_t shift = exp - SUB_BITS;
+        return (1 << SUB_BITS) + shift * (1 << SUB_BITS) + (size_t) ((value >> shift) - (1 << SUB_BITS));
+    }
+
+    // Get largest value that goes to a bucket.
+    static uint64_t Highest (size_t bucket) {
+        if (bucket < (1 << SUB_BITS)) return bucket;
+
+        size_t shift = (bucket - (1 << SUB_BITS)) / (1 << SUB_BITS);
+        uint64_t sub = (bucket - (1 << SUB_BITS)) % (1 << SUB_BITS);
+        return (((1 << SUB_BITS) + sub + 1) << shift) - 1;
+    }
+
+    // Get total of counts from Merge().
+    static uint64_t Total (const std::vector<uint64_t> &counts) {
+        uint64_t total = 0;
+        for (uint64_t c : counts) total += c;
+        return total;
+    }
+
+    // Get value at quantile q (0 < q <= 1) of counts from Merge(), 0 if
+    // there are none.
+    static uint64_t Quantile (const std::vector<uint64_t> &counts, double q) {
+        uint64_t total = Total(counts);
+        if (total == 0) return 0;
+
+        uint64_t rank = (uint64_t) (q * total);
+        if (rank < q * total || rank == 0) rank++;
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen >= rank) return Highest(i);
+        }
+
+        return Highest(counts.size() - 1);
+    }
+
+private:
+    Counter _buckets[BUCKETS];
+};
+
+}
+
+#endif // DIST_HISTOGRAM_H
@@ -1,17 +1,25 @@
 #ifndef DIST_LOG_H
 #define DIST_LOG_H
+#include "logger.h"
 #include <stdio.h>
 
 #define log_info(fmt, ...) log("INFO ", fmt, ## __VA_ARGS__)
 #define log_notice(fmt, ...) log("NOTE ", fmt, ## __VA_ARGS__)
 #define log_warn(fmt, ...) log("WARN ", fmt, ## __VA_ARGS__)
 #define log_error(fmt, ...) log("ERROR", fmt, ## __VA_ARGS__)
-#define log_fatal(fmt, ...) log("FATAL", fmt, ## __VA_ARGS__)
 
 #ifndef DIST_SILENCE
-#define log(log_level, fmt, ...) fprintf(stderr, "[" log_level "] %s: " fmt, __PRETTY_FUNCTION__, ## __VA_ARGS__)
+// arguments are only evaluated if call site is not over its rate limit. the
+// fprintf() is never run, it keeps format checking.
+#define log(log_level, fmt, ...) do { \
+    static ::distributor::LogSite _log_site (log_level, __PRETTY_FUNCTION__, fmt); \
+    if (_log_site.Allow()) ::distributor::Logger::Write(_log_site, ## __VA_ARGS__); \
+    if (false) fprintf(stderr, fmt, ## __VA_ARGS__); \
+} while (0)
+#define log_fatal(fmt, ...) do { log("FATAL", fmt, ## __VA_ARGS__); ::distributor::Logger::Flush(); } while (0)
 #else
 #define log(log_level, fmt, ...)
+#define log_fatal(fmt, ...)
 #endif // DIST_SILENCE
 
 #ifdef DIST_DEBUG
@@ -26,4 +34,4 @@
 #define log_logic(fmt, ...)
 #endif // DIST_LOGIC_DEBUG
 
-#endif // DIST_LOG_H
\ No newline at end of file
+#endif // DIST_LOG_H
@@ -0,0 +1,234 @@
+#include "logger.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+
+namespace distributor {
+
+// rings of every thread that ever logged, and the formatter thread. never
+// freed, threads may still log while the process exits.
+struct logger_state {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<void *> buffers;
+    std::thread formatter;
+    bool running = false;
+    bool stopped = false;
+    uint64_t reported = 0;
+};
+
+static logger_state& state () {
+    static logger_state *s = new logger_state;
+    return *s;
+}
+
+static thread_local void *thread_buffer = nullptr;
+
+struct Logger::log_buffer* Logger::Buffer () {
+    if (thread_buffer != nullptr) return (struct log_buffer *) thread_buffer;
+
+    struct log_buffer *buf = new log_buffer;
+    logger_state &s = state();
+    std::lock_guard<std::mutex> lock (s.mtx);
+    s.buffers.push_back(buf);
+    thread_buffer = buf;
+
+    // not restarted once stopped at exit.
+    if (!s.running && !s.stopped) {
+        s.running = true;
+        s.formatter = std::thread(&Logger::Formatter);
+        atexit(&Logger::Stop);
+    }
+
+    return buf;
+}
+
+void Logger::Format (const uint8_t *rec, std::string &out) {
+    const struct log_hdr *hdr = (const struct log_hdr *) rec;
+    const struct log_arg *args = (const struct log_arg *) (hdr + 1);
+    const char *str = (const char *) (args + hdr->nargs);
+    const LogSite &site = *hdr->site;
+    char buf[512];
+
+    if (hdr->suppressed > 0) {
+        snprintf(buf, sizeof(buf), "[%s] %s: (%" PRIu32 " messages suppressed)\n", site.level, site.func, hdr->suppressed);
+        out += buf;
+    }
+
+    snprintf(buf, sizeof(buf), "[%s] %s: ", site.level, site.func);
+    out += buf;
+
+    size_t next = 0;
+
+    for (const char *p = site.fmt; *p != '\0'; p++) {
+        if (*p != '%') {
+            out += *p;
+            continue;
+        }
+
+        if (p[1] == '%') {
+            out += '%';
+            p++;
+            continue;
+        }
+
+        // conversion spec: keep flags, width and precision, drop length
+        // modifiers, arguments are stored 64 bits wide.
+        char spec[32];
+        size_t n = 0;
+        const char *q = p + 1;
+        spec[n++] = '%';
+
+        while (*q != '\0' && strchr("-+ #0123456789.", *q) != nullptr && n < sizeof(spec) - 4) spec[n++] = *q++;
+        while (*q != '\0' && strchr("hlzjtL", *q) != nullptr) q++;
+
+        char conv = *q;
+
+        if (conv == '\0' || next >= hdr->nargs) {
+            out.append(p, q - p + (conv != '\0'));
+            if (conv == '\0') break;
+            p = q;
+            continue;
+        }
+
+        const struct log_arg &arg = args[next++];
+
+        switch (conv) {
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+                if (conv != 'c') {
+                    spec[n++] = 'l';
+                    spec[n++] = 'l';
+                }
+                spec[n++] = conv;
+                spec[n] = '\0';
+
+                if (arg.type == A_DOUBLE) snprintf(buf, sizeof(buf), spec, (long long) arg.d);
+                else if (conv == 'c') snprintf(buf, sizeof(buf), spec, (int) arg.i);
+                else snprintf(buf, sizeof(buf), spec, arg.i);
+
+                out += buf;
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                spec[n++] = conv;
+                spec[n] = '\0';
+                snprintf(buf, sizeof(buf), spec, arg.type == A_DOUBLE ? arg.d : arg.type == A_INT ? (double) arg.i : (double) arg.u);
+                out += buf;
+                break;
+            case 's':
+                if (arg.type == A_STR) {
+                    out.append(str, arg.len);
+                    str += arg.len;
+                }
+                break;
+            default:
+                out.append(p, q - p + 1);
+        }
+
+        p = q;
+    }
+}
+
+size_t Logger::Drain (std::string &out) {
+    logger_state &s = state();
+    size_t n = 0;
+    uint64_t dropped = 0;
+
+    std::vector<void *> buffers;
+    {
+        std::lock_guard<std::mutex> lock (s.mtx);
+        buffers = s.buffers;
+    }
+
+    for (void *p : buffers) {
+        struct log_buffer *buf = (struct log_buffer *) p;
+        const uint8_t *rec;
+        size_t size;
+
+        while ((rec = buf->ring.Read(size)) != nullptr) {
+            Format(rec, out);
+            n++;
+        }
+
+        buf->ring.Release();
+        dropped += buf->dropped.load(std::memory_order_relaxed);
+    }
+
+    if (dropped != s.reported) {
+        char line[128];
+        snprintf(line, sizeof(line), "[WARN ] Logger: %" PRIu64 " messages dropped, log ring full.\n", dropped - s.reported);
+        out += line;
+        s.reported = dropped;
+    }
+
+    return n;
+}
+
+void Logger::Formatter () {
+    logger_state &s = state();
+    std::string out;
+
+    std::unique_lock<std::mutex> lock (s.mtx);
+    while (s.running) {
+        lock.unlock();
+
+        out.clear();
+        size_t n = Drain(out);
+        if (!out.empty()) fwrite(out.data(), 1, out.size(), stderr);
+
+        lock.lock();
+        if (n == 0) {
+            s.cv.notify_all();
+            s.cv.wait_for(lock, std::chrono::milliseconds(DIST_LOG_POLL));
+        }
+    }
+}
+
+void Logger::Flush () {
+    logger_state &s = state();
+    std::unique_lock<std::mutex> lock (s.mtx);
+    if (!s.running) return;
+
+    // formatter notifies after a pass that found nothing. one pass may have
+    // started before our records were queued, so wait for two.
+    for (int i = 0; i < 2; i++) {
+        s.cv.notify_all();
+        s.cv.wait_for(lock, std::chrono::milliseconds(100));
+    }
+}
+
+void Logger::Stop () {
+    logger_state &s = state();
+
+    {
+        std::lock_guard<std::mutex> lock (s.mtx);
+        if (!s.running) return;
+        s.running = false;
+        s.stopped = true;
+    }
+
+    s.cv.notify_all();
+    s.formatter.join();
+
+    std::string out;
+    Drain(out);
+    if (!out.empty()) fwrite(out.data(), 1, out.size(), stderr);
+}
+
+uint64_t Logger::Dropped () {
+    logger_state &s = state();
+    std::lock_guard<std::mutex> lock (s.mtx);
+    uint64_t dropped = 0;
+
+    for (void *p : s.buffers) {
+        dropped += ((struct log_buffer *) p)->dropped.load(std::memory_order_relaxed);
+    }
+
+    return dropped;
+}
+
+}
@@ -0,0 +1,201 @@
+#ifndef DIST_LOGGER_H
+#define DIST_LOGGER_H
+#include "ring.h"
+#include "clock.h"
+#include "vars.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <type_traits>
+
+namespace distributor {
+
+// LogSite: a log() call site, its fixed parts and its rate limit. Constant
+// initialized, so a static LogSite costs nothing until it is used.
+struct LogSite {
+    constexpr LogSite (const char *level, const char *func, const char *fmt) :
+        level(level), func(func), fmt(fmt), window(0), count(0), suppressed(0) {}
+
+    // Check if one more message may be logged in this second, count it as
+    // suppressed if not.
+    bool Allow () {
+        if (DIST_LOG_RATE == 0) return true;
+
+        uint32_t now = Clock::Now();
+
+        // racy reset, a few extra messages may get through.
+        if (window.load(std::memory_order_relaxed) != now) {
+            window.store(now, std::memory_order_relaxed);
+            count.store(0, std::memory_order_relaxed);
+        }
+
+        if (count.load(std::memory_order_relaxed) >= DIST_LOG_RATE) {
+            suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        count.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    const char *level;
+    const char *func;
+    const char *fmt;
+
+    // second of current window, messages logged in it, and messages dropped
+    // since last one logged.
+    std::atomic<uint32_t> window;
+    std::atomic<uint32_t> count;
+    std::atomic<uint32_t> suppressed;
+};
+
+// Logger: asynchronous logging. log() copies its arguments as a binary record
+// into a ring of the calling thread (no formatting, no locks, no syscalls);
+// a formatter thread turns records into text on stderr. When the ring of a
+// thread is full, records are dropped and counted.
+class Logger {
+public:
+    // Queue a message of call site. Arguments are integers, floating point
+    // numbers or C strings (copied, up to DIST_LOG_STR_MAX bytes).
+    template <typename... Args>
+    static void Write (LogSite &site, Args... args) {
+        size_t size = sizeof(struct log_hdr) + sizeof...(args) * sizeof(struct log_arg) + StrSize(args...);
+        struct log_buffer *buf = Buffer();
+        uint8_t *rec = buf->ring.Reserve(size);
+
+        if (rec == nullptr) {
+            buf->dropped.fetch_add(1 + site.suppressed.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+            return;
+        }
+
+        struct log_hdr *hdr = (struct log_hdr *) rec;
+        hdr->site = &site;
+        hdr->suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+        hdr->nargs = sizeof...(args);
+
+        struct log_arg *arg = (struct log_arg *) (hdr + 1);
+        char *str = (char *) (arg + sizeof...(args));
+        Put(arg, str, args...);
+
+        buf->ring.Commit();
+    }
+
+    // Wait until messages queued so far are written.
+    static void Flush ();
+
+    // Get number of messages dropped because the ring of their thread was
+    // full. Messages suppressed by rate limit are reported with the next
+    // message of their call site instead.
+    static uint64_t Dropped ();
+
+private:
+    enum arg_type {
+        A_INT = 0,
+        A_UINT = 1,
+        A_DOUBLE = 2,
+        A_STR = 3
+    };
+
+    // record: header, nargs arguments, then string bytes of A_STR arguments.
+    struct log_hdr {
+        const LogSite *site;
+        uint32_t suppressed;
+        uint32_t nargs;
+    };
+
+    struct log_arg {
+        uint32_t type;
+        uint32_t len;
+        union {
+            int64_t i;
+            uint64_t u;
+            double d;
+        };
+    };
+
+    // ring of a thread, and messages it dropped.
+    struct log_buffer {
+        log_buffer () : ring(DIST_LOG_RING_SZ), dropped(0) {}
+
+        SpscRing ring;
+        std::atomic<uint64_t> dropped;
+    };
+
+    // Get ring of calling thread, create and register it on first use.
+    static struct log_buffer* Buffer ();
+
+    // Formatter thread.
+    static void Formatter ();
+
+    // Format a record, append it to out.
+    static void Format (const uint8_t *rec, std::string &out);
+
+    // Format every queued record, return number of records.
+    static size_t Drain (std::string &out);
+
+    // Stop formatter thread and write what is left (atexit).
+    static void Stop ();
+
+    static size_t StrLen (const char *s) {
+        return s == nullptr ? 6 : strnlen(s, DIST_LOG_STR_MAX);
+    }
+
+    static size_t StrSize () {
+        return 0;
+    }
+
+    template <typename T, typename... Rest>
+    static size_t StrSize (T, Rest... rest) {
+        return StrSize(rest...);
+    }
+
+    template <typename... Rest>
+    static size_t StrSize (const char *s, Rest... rest) {
+        return StrLen(s) + StrSize(rest...);
+    }
+
+    template <typename... Rest>
+    static size_t StrSize (char *s, Rest... rest) {
+        return StrLen(s) + StrSize(rest...);
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type Encode (struct log_arg &arg, char *&, T v) {
+        arg.type = A_INT;
+        arg.i = v;
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type Encode (struct log_arg &arg, char *&, T v) {
+        arg.type = A_UINT;
+        arg.u = v;
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type Encode (struct log_arg &arg, char *&, T v) {
+        arg.type = A_DOUBLE;
+        arg.d = v;
+    }
+
+    static void Encode (struct log_arg &arg, char *&str, const char *s) {
+        if (s == nullptr) s = "(null)";
+        arg.type = A_STR;
+        arg.len = StrLen(s);
+        memcpy(str, s, arg.len);
+        str += arg.len;
+    }
+
+    static void Put (struct log_arg *&, char *&) {}
+
+    template <typename T, typename... Rest>
+    static void Put (struct log_arg *&arg, char *&str, T v, Rest... rest) {
+        Encode(*arg++, str, v);
+        Put(arg, str, rest...);
+    }
+};
+
+}
+
+#endif // DIST_LOGGER_H
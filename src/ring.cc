@@ -0,0 +1,95 @@
+#include "ring.h"
+#include "log.h"
+
+namespace distributor {
+
+// size value of the filler record at end of the buffer.
+#define RING_WRAP 0xffffffff
+
+SpscRing::SpscRing (size_t size) {
+    if (size == 0 || (size & (size - 1)) != 0) {
+        log_fatal("Ring size %zu is not a power of two.\n", size);
+    }
+    _buffer = new uint8_t[size];
+    _size = size;
+    _mask = size - 1;
+    _tail = 0;
+    _reserved_tail = 0;
+    _cached_head = 0;
+    _head = 0;
+    _read_head = 0;
+    _cached_tail = 0;
+}
+
+SpscRing::~SpscRing () {
+    delete[] _buffer;
+}
+
+size_t SpscRing::Align (size_t size) {
+    return (size + sizeof(rec_hdr) - 1) & ~(sizeof(rec_hdr) - 1);
+}
+
+uint8_t* SpscRing::Reserve (size_t size) {
+    size_t need = sizeof(rec_hdr) + Align(size);
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    size_t offset = tail & _mask;
+    size_t to_end = _size - offset;
+
+    // record must be contiguous, skip the rest of the buffer if it doesn't fit.
+    size_t skip = need > to_end ? to_end : 0;
+
+    if (need + skip > _size) {
+        log_error("Record of %zu bytes will never fit in ring.\n", size);
+        return nullptr;
+    }
+
+    if (tail + skip + need - _cached_head > _size) {
+        _cached_head = _head.load(std::memory_order_acquire);
+        if (tail + skip + need - _cached_head > _size) return nullptr;
+    }
+
+    if (skip > 0) {
+        ((rec_hdr *) &_buffer[offset])->size = RING_WRAP;
+        tail += skip;
+        offset = 0;
+    }
+
+    rec_hdr *hdr = (rec_hdr *) &_buffer[offset];
+    hdr->size = size;
+    _reserved_tail = tail + need;
+
+    return (uint8_t *) (hdr + 1);
+}
+
+void SpscRing::Commit () {
+    _tail.store(_reserved_tail, std::memory_order_release);
+}
+
+const uint8_t* SpscRing::Read (size_t &size) {
+    if (_read_head == _cached_tail) {
+        _cached_tail = _tail.load(std::memory_order_acquire);
+        if (_read_head == _cached_tail) return nullptr;
+    }
+
+    rec_hdr *hdr = (rec_hdr *) &_buffer[_read_head & _mask];
+
+    if (hdr->size == RING_WRAP) {
+        _read_head += _size - (_read_head & _mask);
+        hdr = (rec_hdr *) &_buffer[0];
+    }
+
+    size = hdr->size;
+    _read_head += sizeof(rec_hdr) + Align(size);
+
+    return (const uint8_t *) (hdr + 1);
+}
+
+void SpscRing::Release () {
+    _head.store(_read_head, std::memory_order_release);
+}
+
+bool SpscRing::Empty () const {
+    return _read_head == _tail.load(std::memory_order_acquire);
+}
+
+}
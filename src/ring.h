@@ -0,0 +1,71 @@
+#ifndef DIST_RING_H
+#define DIST_RING_H
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+namespace distributor {
+
+// SpscRing: single-producer, single-consumer ring of variable-size records.
+// Records are contiguous in memory, so the consumer can use them in place
+// until it calls Release().
+class SpscRing {
+public:
+    // size must be a power of two.
+    SpscRing (size_t size);
+    SpscRing (const SpscRing &) = delete;
+    SpscRing& operator= (const SpscRing &) = delete;
+    ~SpscRing ();
+
+    // (producer) Reserve space for a record of size bytes. Return nullptr if
+    // ring is full. Record is not visible to consumer until Commit().
+    uint8_t* Reserve (size_t size);
+
+    // (producer) Publish the record reserved by last Reserve().
+    void Commit ();
+
+    // (consumer) Get next record, return nullptr if ring is empty. The record 
+    // stays valid until Release().
+    const uint8_t* Read (size_t &size);
+
+    // (consumer) Give space of all records returned by Read() back to 
+    // producer.
+    void Release ();
+
+    // (consumer) Check if there are records to read.
+    bool Empty () const;
+
+private:
+    // record header, records are aligned to it.
+    struct rec_hdr {
+        uint32_t size;
+        uint32_t pad;
+    };
+
+    static size_t Align (size_t size);
+
+    // not initialized: pages are only touched (and committed) as records
+    // reach them, so creating a ring is cheap.
+    uint8_t *_buffer;
+    size_t _size;
+    size_t _mask;
+
+    // producer and consumer fields are kept on different cache lines.
+    uint8_t _pad0[64];
+
+    // written by producer
+    std::atomic<size_t> _tail;
+    size_t _reserved_tail;
+    size_t _cached_head;
+
+    uint8_t _pad1[64];
+
+    // written by consumer
+    std::atomic<size_t> _head;
+    size_t _read_head;
+    size_t _cached_tail;
+};
+
+}
+
+#endif // DIST_RING_H
@@ -0,0 +1,72 @@
+#ifndef DIST_SMALL_VECTOR_H
+#define DIST_SMALL_VECTOR_H
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace distributor {
+
+// SmallVector: array of trivially copyable T, first N elements stored
+// inline, moved to heap only when it grows past that.
+template <typename T, size_t N>
+class SmallVector {
+public:
+    SmallVector () : _size(0), _capacity(N) {}
+    SmallVector (const SmallVector &) = delete;
+    SmallVector& operator= (const SmallVector &) = delete;
+
+    ~SmallVector () {
+        if (_capacity > N) delete[] _heap;
+    }
+
+    void push_back (const T &value) {
+        if (_size == _capacity) Grow();
+        Data()[_size++] = value;
+    }
+
+    void pop_back () {
+        _size--;
+
+        // back inline once it fits again.
+        if (_capacity > N && _size <= N / 2) {
+            T *heap = _heap;
+            memcpy(_inline, heap, _size * sizeof(T));
+            delete[] heap;
+            _capacity = N;
+        }
+    }
+
+    T& back () { return Data()[_size - 1]; }
+    T& operator[] (size_t i) { return Data()[i]; }
+    const T& operator[] (size_t i) const { return Data()[i]; }
+
+    const T* begin () const { return Data(); }
+    const T* end () const { return Data() + _size; }
+
+    size_t size () const { return _size; }
+    bool empty () const { return _size == 0; }
+
+private:
+    T* Data () { return _capacity > N ? _heap : _inline; }
+    const T* Data () const { return _capacity > N ? _heap : _inline; }
+
+    void Grow () {
+        T *heap = new T[_capacity * 2];
+        memcpy(heap, Data(), _size * sizeof(T));
+        if (_capacity > N) delete[] _heap;
+        _heap = heap;
+        _capacity *= 2;
+    }
+
+    union {
+        T _inline[N];
+        T *_heap;
+    };
+
+    uint32_t _size;
+    uint32_t _capacity;
+};
+
+}
+
+#endif // DIST_SMALL_VECTOR_H
@@ -0,0 +1,59 @@
+#ifndef DIST_STATS_H
+#define DIST_STATS_H
+#include "vars.h"
+#include <stdint.h>
+#include <atomic>
+
+namespace distributor {
+
+// Counter: counter written by one thread and read by any. Relaxed load and
+// store, so counting is a plain add (no locked instruction); totals are only
+// summed up when read.
+class Counter {
+public:
+    Counter () : _value(0) {}
+    Counter (const Counter &other) : _value(other.Get()) {}
+
+    Counter& operator= (const Counter &other) {
+        _value.store(other.Get(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    void Add (uint64_t n = 1) {
+        _value.store(_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    uint64_t Get () const {
+        return _value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> _value;
+};
+
+// Padded: T on cache lines of its own, so counters written by one thread
+// never share a line with data written by another.
+template <typename T>
+class Padded {
+public:
+    T* operator-> () {
+        return &_value;
+    }
+
+    const T* operator-> () const {
+        return &_value;
+    }
+
+    const T& operator* () const {
+        return _value;
+    }
+
+private:
+    char _before[DIST_CACHE_LINE];
+    T _value;
+    char _after[DIST_CACHE_LINE];
+};
+
+}
+
+#endif // DIST_STATS_H
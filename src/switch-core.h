@@ -0,0 +1,573 @@
+#ifndef DIST_SWITCH_CORE_H
+#define DIST_SWITCH_CORE_H
+#include "types.h"
+#include "fdb.h"
+#include "flow-cache.h"
+#include "small-vector.h"
+#include "stats.h"
+#include "clock.h"
+#include "log.h"
+#include "vars.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace distributor {
+
+// SwitchCore: the learning switch, with its transport and its FDB as
+// compile-time policies, so the forwarding loop is inlined into the
+// transport.
+//
+// Derived (CRTP) must provide
+//     void Send (port_index_t index, port_t dst, const uint8_t *frame, size_t size);
+// to send an ethernet frame to a port, at index (see Plug()), so per-port
+// transport state can be kept in an array (befriend SwitchCore if it is
+// private). FdbT must have the interface of Fdb. See Switch for a version
+// with Send() as a virtual function.
+template <typename Derived, typename FdbT = Fdb>
+class SwitchCore {
+protected:
+    SwitchCore () : _fdb(DIST_FDB_MAX_PORT, DIST_FDB_MAX_NET, DIST_FDB_MAX), _flooded(false) {}
+
+    // Plug a port into a network. Return index of port, it stays the same
+    // until port is unplugged.
+    port_index_t Plug (net_t net, port_t port) {
+        log_debug("Plugging port %" PRIport " to network %" PRInet "...\n", port, net);
+
+        // insert to port -> net mapping
+        struct port_info info;
+        info.net = net;
+        info.fdb = 0;
+        info.index = 0;
+        info.member = 0;
+        std::pair<typename portsmap_t::iterator, bool> rslt = _ports.insert(std::make_pair(port, info));
+
+        // inserted as new entry
+        if (rslt.second) {
+            port_index_t index = AllocIndex(port);
+            rslt.first->second.index = index;
+            _slots[index].info = &rslt.first->second;
+            log_info("Port %" PRIport ": Associated with network %" PRInet ".\n", port, net);
+            Join(rslt.first->second);
+            return index;
+        }
+
+        // otherwise, port is in the map already.
+
+        // record old network id
+        net_t oldnet = rslt.first->second.net;
+
+        log_logic("Old network: %" PRInet ", new network: %" PRInet ".\n", oldnet, net);
+
+        // new network == old network?
+        if (oldnet == net) {
+            log_debug("Port %" PRIport " already associated wtih network %" PRInet ".\n", port, net);
+            return rslt.first->second.index;
+        }
+
+        log_logic("Network changed. Flushing FDB entries for port in old network...\n");
+        FlushFdbPriv(rslt.first->second);
+
+        // update ports map and network id
+        Leave(rslt.first->second);
+        rslt.first->second.net = net;
+        rslt.first->second.flows.Clear();
+        Join(rslt.first->second);
+
+        log_info("Port %" PRIport ": Re-associated to network %" PRInet " from %" PRInet ".\n", port, net, oldnet);
+        return rslt.first->second.index;
+    }
+
+    // Unplug a port from the network. Return true if removed, false otherwise.
+    bool Unplug (port_t port) {
+        log_debug("Unplugging port %" PRIport "...\n", port);
+
+        typename portsmap_t::const_iterator net = GetNetByPort(port);
+        if (net == _ports.end()) {
+            log_notice("Port %" PRIport " was not associated with any network.\n", port);
+            return false;
+        }
+
+        net_t _net = net->second.net;
+        port_index_t index = net->second.index;
+        log_logic("Flushing FDB entries for this port...\n");
+        FlushFdbPriv(net->second);
+        Leave(net->second);
+        FreeIndex(index);
+        _ports.erase(net);
+        log_logic("Removed port %" PRIport " from port -> net mapping.\n", port);
+
+        log_info("Unplugged %" PRIport " from network %" PRInet ".\n", port, _net);
+        return true;
+    }
+
+    // Check if a port is plugged into switch.
+    bool Plugged (port_t port) const {
+        return _ports.find(port) != _ports.end();
+    }
+
+    // Foward an ethernet frame. Return false if port not plugged in. Note that
+    // return true does not necessarily mean that the frame has benn forwarded.
+    bool Forward (port_t src_port, const uint8_t *frame, size_t size) {
+        typename portsmap_t::iterator net_it = _ports.find(src_port);
+        return ForwardFrom(src_port, net_it == _ports.end() ? nullptr : &net_it->second, frame, size);
+    }
+
+    // Same, index is what Plug() returned for src_port, so the port is found
+    // without a lookup. An index that is 0 or no longer src_port's is
+    // ignored.
+    bool Forward (port_index_t index, port_t src_port, const uint8_t *frame, size_t size) {
+        if (index < _slots.size() && _slots[index].port == src_port) return ForwardFrom(src_port, _slots[index].info, frame, size);
+        return Forward(src_port, frame, size);
+    }
+
+    // Check if last frame forwarded was flooded (unknown unicast, broadcast or
+    // multicast destination).
+    bool Flooded () const {
+        return _flooded;
+    }
+
+    // Flush FDB entries for a port.
+    void FlushFdb (port_t port) {
+        log_debug("Flusing FDB for port %" PRIport "...\n", port);
+        typename portsmap_t::const_iterator net_it = GetNetByPort(port);
+        if (net_it == _ports.end()) {
+            log_warn("Port %" PRIport " was not associated with any network.\n", port);
+            return;
+        }
+
+        FlushFdbPriv(net_it->second);
+    }
+
+    // Reset switch. Remove all ports, nets, FDBs.
+    void Reset () {
+        log_debug("Resetting switch...\n");
+        _ports.clear();
+        _nets.clear();
+        _fdb.Clear();
+        _slots.clear();
+        _free_indexes.clear();
+        log_debug("Switch resetted.\n");
+    }
+
+    // Get number of ports plugged in.
+    size_t PortCount () const {
+        return _ports.size();
+    }
+
+    // Remove aged FDB entries, visiting at most budget entries. Next call goes
+    // on where this one stopped.
+    void AgeFdbs (size_t budget) {
+        _fdb.Age(Clock::Now(), budget);
+        log_debug("FDB entries: %zu.\n", _fdb.Size());
+    }
+
+    // counters of switch and its FDB, and size of its tables.
+    struct switch_stats {
+        uint64_t bytes, cached, unicast, unknown, flooded, runts, unplugged;
+        uint64_t learned, moved, evicted, aged, refused;
+        size_t ports, nets, entries;
+    };
+
+    // counters of a port, and of a network (sums of its ports are left to
+    // WriteStats()).
+    struct port_stats {
+        port_t port;
+        net_t net;
+        uint64_t rx_frames, rx_bytes, tx_frames, tx_bytes;
+    };
+
+    struct net_stats {
+        net_t net;
+        size_t ports;
+        size_t entries;
+        uint64_t floods;
+    };
+
+    struct stats_snapshot {
+        struct switch_stats sw;
+        std::vector<struct port_stats> ports;
+        std::vector<struct net_stats> nets;
+    };
+
+    // Copy counters to snap, a few ports at a time: the switch and FDB
+    // (when pos is 0), then ports from port index pos on, at most max of
+    // them, with their networks. pos is advanced, return true when every
+    // port is copied. Ports plugged or unplugged between two calls may be
+    // missed. Only copies: WriteStats() formats snap, on any thread.
+    bool SnapshotStats (struct stats_snapshot &snap, size_t &pos, size_t max) const {
+        if (pos == 0) {
+            const struct switch_counters &s = *_stats;
+            const typename FdbT::fdb_counters &f = _fdb.Counters();
+            struct switch_stats sw = {
+                s.bytes.Get(), s.cached.Get(), s.unicast.Get(), s.unknown.Get(), s.flooded.Get(), s.runts.Get(), s.unplugged.Get(),
+                f.learned.Get(), f.moved.Get(), f.evicted.Get(), f.aged.Get(), f.refused.Get(),
+                _ports.size(), _nets.size(), _fdb.Size()
+            };
+
+            snap.sw = sw;
+            snap.ports.clear();
+            snap.nets.clear();
+            pos = 1;
+        }
+
+        for (size_t n = 0; pos < _slots.size() && n < max; pos++) {
+            const struct port_slot &slot = _slots[pos];
+            const struct port_info *info = slot.info;
+            if (info == nullptr) continue;
+
+            struct port_stats p = { slot.port, info->net, info->rx_frames.Get(), info->rx_bytes.Get(), slot.tx_frames.Get(), slot.tx_bytes.Get() };
+            snap.ports.push_back(p);
+            n++;
+
+            // network goes with its first port.
+            if (info->member != 0) continue;
+            typename netsmap_t::const_iterator net_it = _nets.find(info->net);
+            if (net_it == _nets.end()) continue;
+
+            const struct net_info &net = net_it->second;
+            struct net_stats ns = { info->net, net.ports.size(), _fdb.NetSize(net.fdb), net.floods.Get() };
+            snap.nets.push_back(ns);
+        }
+
+        if (pos < _slots.size()) return false;
+
+        pos = 0;
+        return true;
+    }
+
+    // Append stats in snap to out, one line per object ("<kind> <id> [key
+    // value]..."): switch, FDB, ports and networks. Traffic of a network is
+    // summed up here from its ports. label tells switches apart.
+    static void WriteStats (std::string &out, size_t label, const struct stats_snapshot &snap) {
+        char line[512];
+        const struct switch_stats &s = snap.sw;
+        uint64_t frames = s.cached + s.unicast + s.unknown + s.flooded;
+
+        snprintf(line, sizeof(line), "switch %zu frames %" PRIu64 " bytes %" PRIu64 " cached %" PRIu64 " unicast %" PRIu64 " unknown %" PRIu64 " flooded %" PRIu64 " runts %" PRIu64 " unplugged %" PRIu64 " ports %zu networks %zu\n",
+            label, frames, s.bytes, s.cached, s.unicast, s.unknown, s.flooded, s.runts, s.unplugged, s.ports, s.nets);
+        out += line;
+
+        snprintf(line, sizeof(line), "fdb %zu entries %zu learned %" PRIu64 " moved %" PRIu64 " evicted %" PRIu64 " aged %" PRIu64 " refused %" PRIu64 "\n",
+            label, s.entries, s.learned, s.moved, s.evicted, s.aged, s.refused);
+        out += line;
+
+        // traffic of every network (map values start at zero).
+        struct traffic {
+            uint64_t rx_frames, rx_bytes, tx_frames, tx_bytes;
+        };
+
+        std::unordered_map<net_t, struct traffic> nets;
+
+        for (const struct port_stats &p : snap.ports) {
+            struct traffic &sum = nets[p.net];
+            sum.rx_frames += p.rx_frames;
+            sum.rx_bytes += p.rx_bytes;
+            sum.tx_frames += p.tx_frames;
+            sum.tx_bytes += p.tx_bytes;
+
+            snprintf(line, sizeof(line), "port %" PRIport " net %" PRInet " switch %zu rx_frames %" PRIu64 " rx_bytes %" PRIu64 " tx_frames %" PRIu64 " tx_bytes %" PRIu64 "\n",
+                p.port, p.net, label, p.rx_frames, p.rx_bytes, p.tx_frames, p.tx_bytes);
+            out += line;
+        }
+
+        for (const struct net_stats &n : snap.nets) {
+            const struct traffic &sum = nets[n.net];
+
+            snprintf(line, sizeof(line), "net %" PRInet " switch %zu ports %zu fdb %zu rx_frames %" PRIu64 " rx_bytes %" PRIu64 " tx_frames %" PRIu64 " tx_bytes %" PRIu64 " floods %" PRIu64 "\n",
+                n.net, label, n.ports, n.entries, sum.rx_frames, sum.rx_bytes, sum.tx_frames, sum.tx_bytes, n.floods);
+            out += line;
+        }
+    }
+
+    // plugged port: its network and the index of the network in FDB, its
+    // index in FDB, its position in port list of the network, what it sent to
+    // the switch, and its recent known unicast flows.
+    struct port_info {
+        net_t net;
+        net_index_t fdb;
+        port_index_t index;
+        uint32_t member;
+        Counter rx_frames;
+        Counter rx_bytes;
+        FlowCache<DIST_FLOW_CACHE> flows;
+    };
+
+    typedef SmallVector<port_index_t, DIST_NET_SMALL> portlist_t;
+
+    // network with ports plugged in: index of its ports (dense array, for
+    // broadcasting), its index in FDB and number of frames flooded on it.
+    // removed (and closed in FDB) with its last port.
+    struct net_info {
+        portlist_t ports;
+        net_index_t fdb;
+        Counter floods;
+    };
+
+    // frames by what switch did with them: sent to a cached or looked up
+    // destination, flooded for an unknown unicast destination or for a
+    // broadcast/multicast one, dropped as too short or from a port not
+    // plugged in.
+    struct switch_counters {
+        Counter bytes;
+        Counter cached;
+        Counter unicast;
+        Counter unknown;
+        Counter flooded;
+        Counter runts;
+        Counter unplugged;
+    };
+
+    // port at a port index, and what switch sent to it. kept together,
+    // forwarding to a port touches both. also the record of the port (in
+    // ports map, where it does not move), to find a source port by index.
+    struct port_slot {
+        port_slot () : port(0), info(nullptr) {}
+
+        port_t port;
+        Counter tx_frames;
+        Counter tx_bytes;
+        struct port_info *info;
+    };
+
+    typedef std::unordered_map<port_t, struct port_info> portsmap_t;
+    typedef std::unordered_map<net_t, struct net_info> netsmap_t;
+
+private:
+    Derived& Self () {
+        return *static_cast<Derived *>(this);
+    }
+
+    // don't be confused by portsmap_t and netsmap_t. The key type in portsmap_t
+    // is port_t, but value type is net_t, thus GetNetsByPort return portsmap_t.
+    typename portsmap_t::const_iterator GetNetByPort (port_t port) const {
+        return _ports.find(port);
+    }
+
+    // Add port to port list of network info.net, network is created if it
+    // does not exist.
+    void Join (struct port_info &info) {
+        struct net_info &n = _nets[info.net];
+        if (n.ports.empty()) n.fdb = _fdb.Open(info.net);
+
+        info.fdb = n.fdb;
+        info.member = (uint32_t) n.ports.size();
+        n.ports.push_back(info.index);
+    }
+
+    // Remove port from port list of network info.net (the last port takes
+    // its place). Network is removed with the last port.
+    void Leave (const struct port_info &info) {
+        typename netsmap_t::iterator it = _nets.find(info.net);
+
+        if (it == _nets.end() || info.member >= it->second.ports.size()) {
+            log_error("Port was missing from net -> ports mapping.\n");
+            return;
+        }
+
+        portlist_t &ports = it->second.ports;
+        port_index_t last = ports.back();
+        ports[info.member] = last;
+        _slots[last].info->member = info.member;
+        ports.pop_back();
+
+        if (ports.empty()) {
+            log_debug("Last port left network %" PRInet ", removing.\n", info.net);
+            _fdb.Close(it->second.fdb);
+            _nets.erase(it);
+        }
+    }
+
+    // Forward an ethernet frame from src_port, its record is src_info
+    // (nullptr if not plugged in). See Forward().
+    bool ForwardFrom (port_t src_port, struct port_info *src_info, const uint8_t *frame, size_t size) {
+        log_debug("Forwarding ethernet frame of size %zu from port %" PRIport ".\n", size, src_port);
+        _flooded = false;
+
+        if (size < sizeof(struct ether_header)) {
+            _stats->runts.Add();
+            log_warn("Invalid ethernet frame from port %" PRIport ": size too small.\n", src_port);
+            return true;
+        }
+
+        log_logic("Got packet on port %" PRIport ".\n", src_port);
+        const struct ether_header *hdr = (const struct ether_header *) frame;
+        const struct ether_addr *src = (const struct ether_addr *) hdr->ether_shost;
+        const struct ether_addr *dst = (const struct ether_addr *) hdr->ether_dhost;
+        log_logic("SRC: %s\n", ether_ntoa(src));
+        log_logic("DST: %s\n", ether_ntoa(dst));
+
+        if (src_info == nullptr) {
+            _stats->unplugged.Add();
+            log_warn("Port %" PRIport " was not associated with any network.\n", src_port);
+            return false;
+        }
+
+        struct port_info &info = *src_info;
+        net_t net = info.net;
+        bool src_unicast = !IsBroadcast(*src) && !IsMulticast(*src);
+        bool dst_unicast = !IsBroadcast(*dst) && !IsMulticast(*dst);
+        uint64_t src_mac = 0, dst_mac = 0;
+
+        info.rx_frames.Add();
+        info.rx_bytes.Add(size);
+        _stats->bytes.Add(size);
+
+        if (src_unicast && dst_unicast) {
+            src_mac = FdbT::Pack(*src);
+            dst_mac = FdbT::Pack(*dst);
+            uint32_t *seen;
+            port_index_t dst_index = info.flows.Find(src_mac, dst_mac, _fdb.Generation(info.fdb), seen);
+
+            if (dst_index != 0) {
+                // FDB unchanged since pair was cached, only keep SRC from ageing.
+                uint32_t now = Clock::Now();
+
+                if (now - *seen >= DIST_FDB_REFRESH) {
+                    *seen = now;
+                    _fdb.Insert(info.fdb, info.index, *src);
+                }
+
+                port_t dst_port = _slots[dst_index].port;
+                log_logic("Forwarding frame to port %" PRIport " (cached).\n", dst_port);
+                _stats->cached.Add();
+                CountTx(dst_index, size);
+                Self().Send(dst_index, dst_port, frame, size);
+                return true;
+            }
+        }
+
+        if (src_unicast) {
+            log_logic("SRC address %s was not broadcast or multicast, inserting into FDB.\n", ether_ntoa(src));
+            _fdb.Insert(info.fdb, info.index, *src);
+        }
+
+        if (dst_unicast) {
+            log_logic("DST address %s was not broadcast or multicast, looking up from FDB.\n", ether_ntoa(dst));
+            port_index_t dst_index = _fdb.Lookup(info.fdb, *dst);
+
+            if (dst_index != 0) {
+                if (src_unicast) info.flows.Add(src_mac, dst_mac, _fdb.Generation(info.fdb), dst_index, Clock::Now());
+
+                port_t dst_port = _slots[dst_index].port;
+                log_logic("Forwarding frame to port %" PRIport ".\n", dst_port);
+                _stats->unicast.Add();
+                CountTx(dst_index, size);
+                Self().Send(dst_index, dst_port, frame, size);
+                return true;
+            }
+
+            log_debug("DST address %s was not in FDB, flooding all ports on network %" PRInet ".\n", ether_ntoa(dst), net);
+            _stats->unknown.Add();
+            Broadcast(info.index, net, frame, size);
+            return true;
+        }
+
+        // TODO: proper multicast
+        log_logic("DST address is broadcast or multicast, flooding all ports on network %" PRInet ".\n", net);
+        _stats->flooded.Add();
+        Broadcast(info.index, net, frame, size);
+        return true;
+    }
+
+    // Flush FDB, private version. No write mutex.
+    void FlushFdbPriv (const struct port_info &info) {
+        log_debug("Flushing FDB for port index %" PRIpidx "...\n", info.index);
+        _fdb.Discard(info.fdb, info.index);
+    }
+
+    // Give a new port an index.
+    port_index_t AllocIndex (port_t port) {
+        if (_slots.empty()) _slots.resize(1);
+
+        struct port_slot slot;
+        slot.port = port;
+
+        if (_free_indexes.empty()) {
+            _slots.push_back(slot);
+            return (port_index_t) (_slots.size() - 1);
+        }
+
+        port_index_t index = _free_indexes.back();
+        _free_indexes.pop_back();
+        _slots[index] = slot;
+        return index;
+    }
+
+    // Give back index of an unplugged port.
+    void FreeIndex (port_index_t index) {
+        _slots[index].port = 0;
+        _slots[index].info = nullptr;
+        _free_indexes.push_back(index);
+    }
+
+    // Count a frame sent to port index.
+    void CountTx (port_index_t index, size_t size) {
+        struct port_slot &slot = _slots[index];
+        slot.tx_frames.Add();
+        slot.tx_bytes.Add(size);
+    }
+
+    // Relay an ethernet frame to every ports on a network, except the one at
+    // index src_index.
+    void Broadcast (port_index_t src_index, net_t net, const uint8_t *frame, size_t size) {
+        log_debug("Broadcast to network %" PRInet ", skipping source port %" PRIport "...\n", net, _slots[src_index].port);
+
+        typename netsmap_t::iterator it = _nets.find(net);
+
+        if (it == _nets.end()) {
+            log_error("No ports are connected to network %" PRInet ", can't broadcast.\n", net);
+            return;
+        }
+
+        it->second.floods.Add();
+        _flooded = true;
+
+        for (port_index_t dst_index : it->second.ports) {
+            if (dst_index == src_index) continue;
+            port_t dst_port = _slots[dst_index].port;
+            log_logic("Forwarding frame to port %" PRIport "...\n", dst_port);
+            CountTx(dst_index, size);
+            Self().Send(dst_index, dst_port, frame, size);
+        }
+    }
+
+    // Check if an ethernet address is broadcast.
+    static bool IsBroadcast (const struct ether_addr &addr) {
+        const uint16_t *a = (const uint16_t *) &addr;
+        return a[0] == 0xffff && a[1] == 0xffff && a[2] == 0xffff;
+    }
+
+    // Check if an ethernet address is multicast.
+    static bool IsMulticast (const struct ether_addr &addr) {
+        const uint16_t *a16 = (const uint16_t *) &addr;
+        const uint8_t *a8 = (const uint8_t *) &addr;
+        return (a16[0] == 0x3333) || (a16[0] == 0x0100 && a8[2] == 0x5e);
+    }
+
+    // port to network mapping
+    portsmap_t _ports;
+
+    // port index to port and what was sent to it (index 0 is unused), and
+    // indexes free for reuse.
+    std::vector<struct port_slot> _slots;
+    std::vector<port_index_t> _free_indexes;
+
+    // network to ports mapping
+    netsmap_t _nets;
+
+    // (network index, address) to port index mapping
+    FdbT _fdb;
+
+    Padded<struct switch_counters> _stats;
+
+    // last frame forwarded was flooded.
+    bool _flooded;
+};
+
+}
+
+#endif // DIST_SWITCH_CORE_H
@@ -0,0 +1,86 @@
+#ifndef DIST_TIMER_WHEEL_H
+#define DIST_TIMER_WHEEL_H
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace distributor {
+
+// TimerWheel: hashed timing wheel. Timers (opaque values of type T) are
+// scheduled at a deadline and returned by Advance() once it has passed.
+// Every slot covers one tick; a timer further away than the whole wheel
+// stays in its slot for extra turns. Scheduling and firing are O(1), a tick
+// only touches timers in its own slot.
+template <typename T>
+class TimerWheel {
+public:
+    // slots must be a power of two. deadlines and now are in the same unit
+    // as tick.
+    TimerWheel (size_t slots, uint64_t tick, uint64_t now) : _slots(slots) {
+        _mask = slots - 1;
+        _tick = tick;
+        _current = now / tick;
+        _size = 0;
+    }
+
+    // Schedule value at deadline. Deadlines already passed fire on next tick.
+    void Schedule (const T &value, uint64_t deadline) {
+        uint64_t tick = deadline / _tick;
+        if (tick <= _current) tick = _current + 1;
+
+        struct timer t;
+        t.value = value;
+        t.tick = tick;
+        _slots[tick & _mask].push_back(t);
+        _size++;
+    }
+
+    // Move clock to now, append values of timers that are due to due.
+    void Advance (uint64_t now, std::vector<T> &due) {
+        uint64_t target = now / _tick;
+        if (target <= _current) return;
+
+        // after a long pause, one turn of the wheel visits every timer.
+        uint64_t steps = target - _current;
+        if (steps > _slots.size()) steps = _slots.size();
+
+        for (uint64_t i = 1; i <= steps; i++) {
+            std::vector<struct timer> &slot = _slots[(_current + i) & _mask];
+            size_t kept = 0;
+
+            for (size_t j = 0; j < slot.size(); j++) {
+                if (slot[j].tick <= target) {
+                    due.push_back(slot[j].value);
+                    _size--;
+                } else slot[kept++] = slot[j];
+            }
+
+            slot.resize(kept);
+        }
+
+        _current = target;
+    }
+
+    // Get number of scheduled timers.
+    size_t Size () const {
+        return _size;
+    }
+
+private:
+    struct timer {
+        T value;
+        uint64_t tick;
+    };
+
+    std::vector<std::vector<struct timer>> _slots;
+    size_t _mask;
+    uint64_t _tick;
+
+    // last tick processed.
+    uint64_t _current;
+    size_t _size;
+};
+
+}
+
+#endif // DIST_TIMER_WHEEL_H
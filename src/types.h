@@ -6,12 +6,20 @@
 
 #define PRIport PRIu64
 #define PRInet PRIu32
+#define PRIpidx PRIu32
+#define PRInidx PRIu32
 
 namespace distributor {
 
 typedef ::uint64_t port_t;
 typedef ::uint32_t net_t;
 
+// dense index of a port plugged into a switch, 0 is never used.
+typedef ::uint32_t port_index_t;
+
+// dense index of a network in a forwarding database (see Fdb::Open()).
+typedef ::uint32_t net_index_t;
+
 struct dist_header {
     uint16_t magic;
     uint8_t msg_type;
@@ -1,53 +1,62 @@
 #include "udp-distributor.h"
+#include "udp-worker.h"
+#include "timer-wheel.h"
+#include "clock.h"
+#include "logger.h"
 #include "log.h"
 #include "vars.h"
+#include <stdio.h>
 #include <string.h>
-#include <fcntl.h>
+#include <inttypes.h>
 #include <unistd.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 
 namespace distributor {
 
-InetSocketAddress::InetSocketAddress() {}
-InetSocketAddress::InetSocketAddress(const struct sockaddr_in &addr) {
-    memcpy(&address, &addr, sizeof(struct sockaddr_in));
-    hash = addr.sin_addr.s_addr + (addr.sin_port << sizeof(addr.sin_addr.s_addr));
-    log_logic("Hash(%s:%d): %zu\n", inet_ntoa(addr.sin_addr), ntohs(addr.sin_port), hash);
+Client::Client (const struct sockaddr_in &address, port_t port, int fd) {
+    memcpy(&_address, &address, sizeof(struct sockaddr_in));
+    _last_seen = Clock::Now();
+    _last_sent = _last_seen.load();
+    _port = port;
+    _net = 0;
+    _index = 0;
+    _associated = false;
+    _fd = fd;
 }
 
-bool InetSocketAddress::operator== (const InetSocketAddress &other) const {
-    return memcmp(&other, &address, sizeof(struct sockaddr_in)) == 0;
+const struct sockaddr_in& Client::AddrRef () const {
+    return _address;
 }
 
-size_t InetSocketAddress::Hash() const {
-    return hash;
+const struct sockaddr_in* Client::AddrPtr () const {
+    return &_address;
 }
 
-size_t InetSocketAddressHasher::operator() (const InetSocketAddress &key) const {
-    return key.Hash();
+port_t Client::GetPort () const {
+    return _port;
 }
 
-UdpDistributor::UdpDistributor(in_addr_t local_addr, in_port_t local_port) {
-    _local_addr = local_addr;
-    _local_port = local_port;
-    _running = false;
-    _next_port = 1;
+net_t Client::GetNetwork () const {
+    return _net;
 }
 
-Client::Client (const struct sockaddr_in &address, int fd) {
-    memcpy(&_address, &address, sizeof(struct sockaddr_in));
-    _last_seen = _last_sent = time(NULL);
-    _fd = fd;
-    dist_header_t *hdr = (dist_header_t *) _send_buffer;
-    hdr->magic = htons(DIST_MAGIC);
+bool Client::IsAssociated () const {
+    return _associated;
 }
 
-const struct sockaddr_in& Client::AddrRef () const {
-    return _address;
+void Client::SetNetwork (net_t net) {
+    _net = net;
+    _index = 0;
+    _associated = true;
 }
 
-const struct sockaddr_in* Client::AddrPtr () const {
-    return &_address;
+port_index_t Client::GetIndex () const {
+    return _index;
+}
+
+void Client::SetIndex (port_index_t index) {
+    _index = index;
 }
 
 ssize_t Client::Disconnect () {
@@ -76,64 +85,78 @@ ssize_t Client::AckAssociate () {
 }
 
 void Client::Saw () {
-    _last_seen = time(NULL);
+    _last_seen.store(Clock::Now(), std::memory_order_relaxed);
 }
 
-bool Client::IsAlive () {
-    int64_t lastseen_diff = time(NULL) - _last_seen;
-    int64_t lastsent_diff = time(NULL) - _last_sent;
+bool Client::IsAlive (time_t now, time_t &next) {
+    time_t last_seen = _last_seen.load(std::memory_order_relaxed);
+    time_t last_sent = _last_sent.load(std::memory_order_relaxed);
+    int64_t lastseen_diff = now - last_seen;
+    int64_t lastsent_diff = now - last_sent;
     log_logic("Client %s:%d last seen %" PRIi64 " seconds ago, last sent %" PRIi64 " seconds ago.\n", inet_ntoa(_address.sin_addr), ntohs(_address.sin_port), lastseen_diff, lastsent_diff);
 
+    if (lastseen_diff >= DIST_UDP_KEEPALIVE * DIST_UDP_RETRIES) {
+        log_debug("Client %s:%d last seen %" PRIi64 " seconds ago, last sent %" PRIi64 " seconds ago, assume client dead.\n", inet_ntoa(_address.sin_addr), ntohs(_address.sin_port), lastseen_diff, lastsent_diff);
+        return false;
+    }
+
     // Need to request keepalive, but still assume client is alive.
     if (lastsent_diff >= DIST_UDP_KEEPALIVE && lastseen_diff >= DIST_UDP_KEEPALIVE) {
         log_debug("Client %s:%d last seen %" PRIi64 " seconds ago, last sent %" PRIi64 " seconds ago, send KEEPALIVE.\n", inet_ntoa(_address.sin_addr), ntohs(_address.sin_port), lastseen_diff, lastsent_diff);
-        Keepalive();
-        return true;
+        if (Keepalive() >= 0) last_sent = now;
     }
 
-    if (lastseen_diff >= DIST_UDP_KEEPALIVE * DIST_UDP_RETRIES) {
-        log_debug("Client %s:%d last seen %" PRIi64 " seconds ago, last sent %" PRIi64 " seconds ago, assume client dead.\n", inet_ntoa(_address.sin_addr), ntohs(_address.sin_port), lastseen_diff, lastsent_diff);
-        SendMsg(M_DISCONNECT);
-        return false;
-    }
+    // next keepalive is due one interval after we last heard from or talked
+    // to client, unless it expires first.
+    next = (last_seen > last_sent ? last_seen : last_sent) + DIST_UDP_KEEPALIVE;
+    time_t expire = last_seen + DIST_UDP_KEEPALIVE * DIST_UDP_RETRIES;
+    if (expire < next) next = expire;
 
     return true;
 }
 
-ssize_t Client::Write (const uint8_t *buffer, size_t size) {
-    dist_header_t *hdr = (dist_header_t *) _send_buffer;
-    hdr->msg_type = M_ETHERNET_FRAME;
-    uint8_t *msg = _send_buffer + sizeof(dist_header_t);
-    size_t pkt_sz = size + sizeof(dist_header_t);
-    if (pkt_sz > DIST_CLIENT_SEND_BUFSZ) {
-        log_error("Ethernet frame size too large. Max size : %d.\n", DIST_CLIENT_SEND_BUFSZ);
-        return 0;
-    }
-    memcpy(msg, buffer, size);
-    ssize_t s_ret = sendto(_fd, _send_buffer, pkt_sz, 0, (const struct sockaddr *) &_address, sizeof(struct sockaddr_in));
+ssize_t Client::SendMsg (msg_type_t type) {
+    dist_header_t hdr;
+    hdr.magic = htons(DIST_MAGIC);
+    hdr.msg_type = type;
+    ssize_t s_ret = sendto(_fd, &hdr, sizeof(dist_header_t), 0, (const struct sockaddr *) &_address, sizeof(struct sockaddr_in));
+
     if (s_ret < 0) {
         log_error("sendto(): %s.\n", strerror(errno));
-    } else if ((size_t) s_ret != pkt_sz) {
+    } else if ((size_t) s_ret != sizeof(dist_header_t)) {
         log_error("sendto() returned %zu.\n", s_ret);
-    } else _last_sent = time(NULL);
+    } else _last_sent.store(Clock::Now(), std::memory_order_relaxed);
 
     return s_ret;
 }
 
-ssize_t Client::SendMsg (msg_type_t type) {
-    dist_header_t *hdr = (dist_header_t *) _send_buffer;
-    hdr->msg_type = type;
-    ssize_t s_ret = sendto(_fd, _send_buffer, sizeof(dist_header_t), 0, (const struct sockaddr *) &_address, sizeof(struct sockaddr_in));
+UdpDistributor::UdpDistributor(in_addr_t local_addr, in_port_t local_port, size_t batch_sz, size_t workers, bool uring, bool udp_offload, const char *stats_path) : _epoch(2) {
+    _local_addr = local_addr;
+    _local_port = local_port;
+    _running = false;
+    _next_port = 1;
 
-    if (s_ret < 0) {
-        log_error("sendto(): %s.\n", strerror(errno));
-    } else if ((size_t) s_ret != sizeof(dist_header_t)) {
-        log_error("sendto() returned %zu.\n", s_ret);
-    } else _last_sent = time(NULL);
+    if (batch_sz < 1) batch_sz = 1;
+    if (batch_sz > DIST_WORKER_BATCH_MAX) {
+        log_warn("Batch size %zu too large, using %d.\n", batch_sz, DIST_WORKER_BATCH_MAX);
+        batch_sz = DIST_WORKER_BATCH_MAX;
+    }
+    _batch_sz = batch_sz;
 
-    return s_ret;
+    if (workers < 1) workers = 1;
+    if (workers > DIST_WORKERS_MAX) {
+        log_warn("Number of workers %zu too large, using %d.\n", workers, DIST_WORKERS_MAX);
+        workers = DIST_WORKERS_MAX;
+    }
+    _n_workers = workers;
+    _uring = uring;
+    _udp_offload = udp_offload;
+    if (stats_path != nullptr) _stats_path = stats_path;
+    _stats_fd = -1;
 }
 
+UdpDistributor::~UdpDistributor() {}
+
 void UdpDistributor::Start () {
     log_debug("Starting distributor...\n");
     if (_running) {
@@ -148,34 +171,37 @@ void UdpDistributor::Start () {
     local_sockaddr.sin_addr.s_addr = _local_addr;
     local_sockaddr.sin_port = _local_port;
 
-    _fd = socket(AF_INET, SOCK_DGRAM, 0);
-
-    if (_fd < 0) {
-        log_fatal("socket(): %s\n", strerror(errno));
-        return;
+    _workers.clear();
+    for (size_t i = 0; i < _n_workers; i++) {
+        _workers.push_back(std::make_shared<UdpWorker>(*this, i));
     }
 
-    /*int fctl_ret = fcntl(_fd, F_SETFL, O_NONBLOCK);
-
-    if (fctl_ret < 0) {
-        log_fatal("fcntl(): %s\n", strerror(errno));
-        return;
-    }*/
-
-    int bind_ret = bind(_fd, (const struct sockaddr *) &local_sockaddr, sizeof(struct sockaddr_in));
+    for (size_t i = 0; i < _n_workers; i++) {
+        if (!_workers[i]->Open(local_sockaddr, _n_workers > 1)) {
+            log_fatal("Failed to open socket for worker %zu.\n", i);
+            for (size_t j = 0; j < i; j++) _workers[j]->Close();
+            _workers.clear();
+            return;
+        }
+    }
 
-    if (bind_ret < 0) {
-        log_fatal("bind(): %s\n", strerror(errno));
+    if (!_stats_path.empty() && !OpenStats()) {
+        log_fatal("Failed to open stats socket %s.\n", _stats_path.c_str());
+        for (std::shared_ptr<UdpWorker> &w : _workers) w->Close();
+        _workers.clear();
         return;
     }
 
     _running = true;
 
-    _threads.push_back(std::thread(&UdpDistributor::Worker, this));
-    std::thread scavenger_thread (&UdpDistributor::Scavenger, this);
-    scavenger_thread.detach();
+    for (size_t i = 0; i < _n_workers; i++) {
+        _threads.push_back(std::thread(&UdpWorker::Run, _workers[i].get()));
+    }
+
+    _scavenger = std::thread(&UdpDistributor::Scavenger, this);
+    if (_stats_fd >= 0) _stats = std::thread(&UdpDistributor::StatsServer, this);
 
-    log_info("Distributor ready.\n");
+    log_info("Distributor ready, %zu worker(s).\n", _n_workers);
 }
 
 void UdpDistributor::Stop () {
@@ -187,213 +213,388 @@ void UdpDistributor::Stop () {
 
     log_debug("Disconnecting clients...\n");
 
-    /*dist_header_t disconnect_request;
-    disconnect_request.magic = DIST_MAGIC;
-    disconnect_request.msg_type = M_DISCONNECT;*/
-
-    for (infomap_t::iterator it = _infos.begin(); it != _infos.end(); it++) {
-        Client &c = *(it->second);
-        log_debug("Sending DISCONNECT to %s:%d.\n", inet_ntoa(c.AddrRef().sin_addr), ntohs(c.AddrRef().sin_port));
-        //ssize_t s_ret = sendto(_fd, &disconnect_request, sizeof(dist_header_t), 0, (const struct sockaddr *) c.AddrPtr(), sizeof(struct sockaddr_in));
-        ssize_t s_ret = c.Disconnect();
-        if (s_ret < 0) log_error("Error sending DISCONNECT to %s:%d: %s.\n", inet_ntoa(c.AddrRef().sin_addr), ntohs(c.AddrRef().sin_port), strerror(errno));
+    {
+        EpochGuard guard (_epoch, CONTROL_READER);
+        for (std::shared_ptr<UdpWorker> &w : _workers) {
+            w->_infos.ForEach([] (Client &c) {
+                log_debug("Sending DISCONNECT to %s:%d.\n", inet_ntoa(c.AddrRef().sin_addr), ntohs(c.AddrRef().sin_port));
+                ssize_t s_ret = c.Disconnect();
+                if (s_ret < 0) log_error("Error sending DISCONNECT to %s:%d: %s.\n", inet_ntoa(c.AddrRef().sin_addr), ntohs(c.AddrRef().sin_port), strerror(errno));
+            });
+        }
     }
 
-    log_debug("Closing socket...\n");
-    int close_ret = close(_fd);
+    _running = false;
+
+    log_debug("Stopping workers...\n");
+    for (std::shared_ptr<UdpWorker> &w : _workers) {
+        w->Wake();
+    }
 
     log_debug("Stopping scavenger...\n");
     _scavenger_cv.notify_all();
 
-    if (close_ret < 0) {
-        log_fatal("close(): %s\n", strerror(close_ret));
+    if (_stats_fd >= 0) {
+        log_debug("Stopping stats server...\n");
+        // wakes accept().
+        shutdown(_stats_fd, SHUT_RDWR);
+        unlink(_stats_path.c_str());
     }
 
-    log_debug("Resetting switch...\n");
-    Switch::Reset();
-
-    log_debug("Cleaning up associations...\n");
-    _clients.clear();
-    _infos.clear();
-
     // TODO: clean up threads vector
 
-    log_info("Distributor stopped.\n");
+    uint64_t rx_msgs = GetRxMsgs();
+    uint64_t rx_datagrams = GetRxDatagrams();
+    uint64_t tx_msgs = GetTxMsgs();
+    uint64_t tx_datagrams = GetTxDatagrams();
 
-    _running = false;
+    log_info("Received %" PRIu64 " datagrams, average batch fill %.2f/%zu.\n", rx_datagrams, GetBatchFill(), _batch_sz);
+    log_info("Coalescing: %.2f datagrams per received message (GRO), %.2f per sent message (GSO).\n", rx_msgs == 0 ? 0 : (double) rx_datagrams / rx_msgs, tx_msgs == 0 ? 0 : (double) tx_datagrams / tx_msgs);
+    log_info("Dropped by kernel: %" PRIu64 " received datagrams (receive queue full), %" PRIu64 " sent datagrams.\n", GetKernelDrops(), GetTxFailures());
+    log_info("Distributor stopped.\n");
 }
 
 void UdpDistributor::Join () {
     for (std::thread &t : _threads) {
         if (t.joinable()) t.join();
     }
+
+    if (_scavenger.joinable()) _scavenger.join();
+    if (_stats.joinable()) _stats.join();
+
+    if (_stats_fd >= 0) {
+        close(_stats_fd);
+        _stats_fd = -1;
+    }
+
+    for (std::shared_ptr<UdpWorker> &w : _workers) {
+        w->Close();
+    }
 }
 
-void UdpDistributor::Worker () {
-    log_debug("started.\n");
-    struct sockaddr_in client_addr;
-    uint8_t buffer[DIST_WOROKER_READ_BUFSZ];
+double UdpDistributor::GetBatchFill () const {
+    uint64_t calls = 0;
+    uint64_t msgs = 0;
 
-    while (_running) {
-        static socklen_t client_addr_len = sizeof(struct sockaddr_in);
+    for (const std::shared_ptr<UdpWorker> &w : _workers) {
+        calls += w->_counters->rx_calls.Get();
+        msgs += w->_counters->rx_msgs.Get();
+    }
 
-        log_logic("waiting for incoming packet...\n");
-        ssize_t len = recvfrom(_fd, buffer, DIST_WOROKER_READ_BUFSZ, 0, (struct sockaddr *) &client_addr, &client_addr_len);
+    if (calls == 0) return 0;
+    return (double) msgs / calls;
+}
 
-        log_logic("Packet from %s:%d.\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+uint64_t UdpDistributor::GetRxMsgs () const {
+    uint64_t msgs = 0;
 
-        if (len < 0) {
-            log_error("recvfrom(): %s.\n", strerror(errno));
-            continue;
-        }
+    for (const std::shared_ptr<UdpWorker> &w : _workers) {
+        msgs += w->_counters->rx_msgs.Get();
+    }
 
-        if (len == 0) {
-            log_error("recvfrom() returned 0.\n");
-            continue;
+    return msgs;
+}
+
+uint64_t UdpDistributor::GetRxDatagrams () const {
+    uint64_t datagrams = 0;
+
+    for (const std::shared_ptr<UdpWorker> &w : _workers) {
+        datagrams += w->_counters->rx_datagrams.Get();
+    }
+
+    return datagrams;
+}
+
+uint64_t UdpDistributor::GetTxMsgs () const {
+    uint64_t msgs = 0;
+
+    for (const std::shared_ptr<UdpWorker> &w : _workers) {
+        msgs += w->_egress.GetTxMessages();
+    }
+
+    return msgs;
+}
+
+uint64_t UdpDistributor::GetTxDatagrams () const {
+    uint64_t datagrams = 0;
+
+    for (const std::shared_ptr<UdpWorker> &w : _workers) {
+        datagrams += w->_egress.GetTxDatagrams();
+    }
+
+    return datagrams;
+}
+
+// append latency line of a histogram sum (see Histogram::Merge()).
+static void write_latency (std::string &out, const char *kind, const char *batch, const std::vector<uint64_t> &counts) {
+    char line[256];
+    snprintf(line, sizeof(line), "latency %s batch %s samples %" PRIu64 " p50 %" PRIu64 " p99 %" PRIu64 " p999 %" PRIu64 " max %" PRIu64 "\n",
+        kind, batch, Histogram::Total(counts), Histogram::Quantile(counts, 0.5), Histogram::Quantile(counts, 0.99), Histogram::Quantile(counts, 0.999), Histogram::Quantile(counts, 1));
+    out += line;
+}
+
+uint64_t UdpDistributor::GetKernelDrops () const {
+    uint64_t drops = 0;
+
+    for (const std::shared_ptr<UdpWorker> &w : _workers) {
+        drops += w->_counters->kernel_drops.Get();
+    }
+
+    return drops;
+}
+
+uint64_t UdpDistributor::GetTxFailures () const {
+    uint64_t failures = 0;
+
+    for (const std::shared_ptr<UdpWorker> &w : _workers) {
+        const EgressQueue::egress_counters &tx = w->_egress.Counters();
+        failures += tx.no_buffer.Get() + tx.would_block.Get() + tx.failed.Get();
+    }
+
+    return failures;
+}
+
+void UdpDistributor::GetStats (std::string &out) {
+    char line[128];
+
+    for (size_t i = 0; i < _workers.size(); i++) {
+        if (!_workers[i]->Stats(out)) {
+            snprintf(line, sizeof(line), "worker %zu timeout 1\n", i);
+            out += line;
         }
+    }
 
-        if ((size_t) len < sizeof(dist_header_t)) {
-            log_warn("received packet too small.\n");
-            continue;
+    // latency (ns) of all workers by unicast/flooded, and by frames
+    // forwarded in the same round. histograms are read while recorded.
+    static const char *kinds[2] = { "unicast", "flood" };
+
+    for (size_t kind = 0; kind < 2; kind++) {
+        std::vector<uint64_t> all;
+
+        for (size_t batch = 0; batch < UdpWorker::BATCH_CLASSES; batch++) {
+            std::vector<uint64_t> counts;
+            for (const std::shared_ptr<UdpWorker> &w : _workers) w->_latency[kind][batch].Merge(counts);
+            if (Histogram::Total(counts) == 0) continue;
+
+            char label[32];
+            if (batch == UdpWorker::BATCH_CLASSES - 1) snprintf(label, sizeof(label), "%zu+", (size_t) 1 << batch);
+            else if (batch == 0) snprintf(label, sizeof(label), "1");
+            else snprintf(label, sizeof(label), "%zu-%zu", (size_t) 1 << batch, ((size_t) 2 << batch) - 1);
+
+            write_latency(out, kinds[kind], label, counts);
+
+            all.resize(counts.size(), 0);
+            for (size_t i = 0; i < counts.size(); i++) all[i] += counts[i];
         }
 
-        const dist_header_t *msg_hdr = (const dist_header_t *) buffer;
+        write_latency(out, kinds[kind], "all", all);
+    }
+
+    snprintf(line, sizeof(line), "logger 0 dropped %" PRIu64 "\n", Logger::Dropped());
+    out += line;
+}
 
-        if (ntohs(msg_hdr->magic) != DIST_MAGIC) {
-            log_warn("received invalid packet from %s:%d (Invalid magic).\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+size_t UdpDistributor::Owner (net_t net) const {
+    return (size_t) ((((uint64_t) net) * 0x9E3779B97F4A7C15ULL) >> 32) % _n_workers;
+}
+
+port_t UdpDistributor::NextPort () {
+    return _next_port.fetch_add(1, std::memory_order_relaxed);
+}
+
+// liveness timer of a client. port tells a reconnected client (same address,
+// new port) from the one the timer was started for.
+struct client_timer {
+    uint64_t key;
+    port_t port;
+    size_t worker;
+};
+
+// current monotonic time in milliseconds (same clock as Clock, in seconds).
+static uint64_t now_ms () {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint64_t UdpDistributor::CheckTime (uint64_t key, uint64_t t) const {
+    uint64_t spread = DIST_UDP_KEEPALIVE * 1000 / 2;
+    if (spread == 0) return t;
+
+    return t + ((key * 0x9E3779B97F4A7C15ULL) >> 32) % spread;
+}
+
+bool UdpDistributor::OpenStats () {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(struct sockaddr_un));
+    addr.sun_family = AF_UNIX;
+
+    if (_stats_path.size() >= sizeof(addr.sun_path)) {
+        log_fatal("Stats socket path too long.\n");
+        return false;
+    }
+
+    memcpy(addr.sun_path, _stats_path.c_str(), _stats_path.size());
+
+    _stats_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (_stats_fd < 0) {
+        log_fatal("socket(): %s\n", strerror(errno));
+        return false;
+    }
+
+    // left over by a previous run.
+    unlink(_stats_path.c_str());
+
+    if (bind(_stats_fd, (const struct sockaddr *) &addr, sizeof(struct sockaddr_un)) < 0 || listen(_stats_fd, 4) < 0) {
+        log_fatal("bind()/listen(): %s\n", strerror(errno));
+        close(_stats_fd);
+        _stats_fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+void UdpDistributor::StatsServer () {
+    log_debug("Stats server started.\n");
+    std::string out;
+
+    while (_running) {
+        int fd = accept4(_stats_fd, NULL, NULL, SOCK_CLOEXEC);
+
+        if (fd < 0) {
+            if (_running && errno != EINTR) log_error("accept(): %s.\n", strerror(errno));
             continue;
         }
 
-        // find/create client info
-        InetSocketAddress c (client_addr);
-        clientsmap_t::iterator cit = _clients.find(c);
-        infomap_t::iterator iit = _infos.end();
-        if (cit == _clients.end()) {
-            log_debug("Client info for %s:%d does not exist, creating...\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
-            port_t port = _next_port++;
-            std::pair<clientsmap_t::iterator, bool> clients_find_ret = _clients.insert(std::make_pair(c, port));
-
-            cit = clients_find_ret.first;
-            if (!clients_find_ret.second) {
-                log_warn("Insert client -> port mapping returned element exist.\n");
-            }
+        // don't let a reader that does not read hold stats server up.
+        struct timeval tv;
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
 
-            std::pair<infomap_t::iterator, bool> info_find_ret = _infos.insert(std::make_pair(port, std::make_shared<Client>(client_addr, _fd)));
+        out.clear();
+        GetStats(out);
 
-            iit = info_find_ret.first;
-            if (!info_find_ret.second) {
-                log_warn("Insert port -> info mapping returned element exist.\n");
+        for (size_t off = 0; off < out.size(); ) {
+            ssize_t s_ret = send(fd, out.data() + off, out.size() - off, MSG_NOSIGNAL);
+            if (s_ret <= 0) {
+                if (s_ret < 0 && errno == EINTR) continue;
+                log_warn("Error writing stats: %s.\n", strerror(errno));
+                break;
             }
-            
-            iit->second->Associate();
-            log_info("New client from %s:%d, assigned port: %" PRIport ".\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), port);
+            off += (size_t) s_ret;
         }
 
-        port_t port = cit->second;
-        if (iit == _infos.end()) iit = _infos.find(port);
-        if (iit == _infos.end()) {
-            log_warn("Client found in client -> port mapping but not port -> info mapping.\n");
-            std::pair<infomap_t::iterator, bool> info_find_ret = _infos.insert(std::make_pair(port, std::make_shared<Client>(client_addr, _fd)));
+        close(fd);
+    }
+
+    log_debug("Stats server stopped.\n");
+}
 
-            iit = info_find_ret.first;
-            if (!info_find_ret.second) {
-                log_warn("Re-Insert port -> info mapping returned element exist.\n");
+void UdpDistributor::Scavenger () {
+    log_debug("Scavenger started.\n");
+
+    TimerWheel<struct client_timer> wheel (DIST_TIMER_WHEEL_SLOTS, DIST_SCAVENGER_TICK, now_ms());
+    std::vector<struct client_timer> due;
+    std::vector<bool> posted (_n_workers, false);
+
+    std::unique_lock<std::mutex> lock (_scavenger_mtx);
+    while (_running) {
+        Clock::Tick();
+        uint64_t now = now_ms();
+
+        // start timers of new clients.
+        for (size_t i = 0; i < _workers.size(); i++) {
+            SpscRing &watch = _workers[i]->_watch;
+            const uint8_t *rec;
+            size_t rec_sz;
+
+            while ((rec = watch.Read(rec_sz)) != nullptr) {
+                const watch_msg_t *w = (const watch_msg_t *) rec;
+                struct client_timer timer;
+                timer.key = w->key;
+                timer.port = w->port;
+                timer.worker = i;
+                wheel.Schedule(timer, CheckTime(timer.key, now + DIST_UDP_KEEPALIVE * 1000));
             }
+
+            watch.Release();
         }
 
-        size_t msg_len = (size_t) len - sizeof(dist_header_t);
-        const uint8_t *msg_ptr = buffer + sizeof(dist_header_t);
-
-        // now we have complete picture of who client is (iit & cit), process client's message
-        switch (msg_hdr->msg_type) {
-            case M_ETHERNET_FRAME:
-                log_logic("Got M_ETHERNET_FRAME from client on port %" PRIport ".\n", port);
-                if (!Forward(port, msg_ptr, msg_len)) {
-                    log_info("Sending associate request to client on port %" PRIport ".\n", port);
-                    iit->second->Associate();
-                }
-                break;
-            case M_ASSOCIATE_REQUEST: {
-                log_logic("Got M_ASSOCIATE_REQUEST from client on port %" PRIport ".\n", port);
-                if (msg_len != sizeof(net_t)) {
-                    log_warn("Invalid ASSOCIATE_REQUEST message from client on port %" PRIport ". (len = %zu)\n", port, msg_len);
-                    break;
-                }
-                net_t net = ntohl(*(const net_t *) msg_ptr);
-                log_info("Associating client on port %" PRIport " with network %" PRInet ".\n", port, net);
-                Plug(net, port);
-                iit->second->AckAssociate();
-                break;
-            }
-            case M_KEEPALIVE_REQUEST: 
-                log_logic("Got M_KEEPALIVE_REQUEST from client on port %" PRIport ".\n", port);
-                iit->second->AckKeepalive();
-                break;
-            case M_KEEPALIVE_RESPOND:
-                log_logic("Got M_KEEPALIVE_RESPOND from client on port %" PRIport ".\n", port);
-                break;
-            case M_DISCONNECT: {
-                log_logic("Got M_DISCONNECT from client on port %" PRIport ".\n", port);
-                log_info("Got disconnect request from client on port %" PRIport ", unregister client.\n", port);
-                Unplug(port);
-                _clients.erase(cit);
-                _infos.erase(iit);
+        due.clear();
+        wheel.Advance(now, due);
+
+        // clients are looked up while their workers run. don't stay in the
+        // epoch while waiting, it holds back reclamation.
+        _epoch.Enter(SCAVENGER_READER);
+
+        for (const struct client_timer &timer : due) {
+            size_t i = timer.worker;
+            port_t port = timer.port;
+            UdpWorker &w = *_workers[i];
+
+            // worker may remove the client meanwhile, but it is not freed
+            // while we are in the epoch.
+            Client *client = w._infos.Find(timer.key);
+
+            // client is already gone (or came back as a new client, which has
+            // its own timer), drop its timer.
+            if (client == nullptr || client->GetPort() != port) continue;
+
+            time_t next;
+            if (client->IsAlive(now / 1000, next)) {
+                wheel.Schedule(timer, CheckTime(timer.key, (uint64_t) next * 1000));
                 continue;
             }
-            default:
-                log_warn("Invalid message type %d from client on port %" PRIport ".\n", msg_hdr->msg_type, port);
+
+            // client is dead, ask its worker to remove it.
+            SpscRing &ring = w.Inbound(_n_workers);
+            worker_msg_t *msg = (worker_msg_t *) ring.Reserve(sizeof(worker_msg_t));
+            if (msg == nullptr) {
+                log_warn("Ring of worker %zu is full, will retry.\n", i);
+                wheel.Schedule(timer, now + DIST_SCAVENGER_TICK);
                 continue;
+            }
+
+            client->Disconnect();
+            log_info("Client on port %" PRIport " seems to be dead, remove.\n", port);
+
+            memset(msg, 0, sizeof(worker_msg_t));
+            msg->type = W_EXPIRE;
+            msg->port = port;
+            msg->address = client->AddrRef();
+            ring.Commit();
+            posted[i] = true;
         }
 
-        // "continue" not called (i.e. valid msg from client, update last seen.)
-        log_logic("Updating last seen for client on port %" PRIport ".\n", port);
-        iit->second->Saw();
+        _epoch.Leave(SCAVENGER_READER);
 
-        // FIXME: what if iit/cit got deleted during message processing?
-    }
+        // let workers age their fdbs. skipped for this tick if ring is full.
+        for (size_t i = 0; i < _workers.size(); i++) {
+            SpscRing &ring = _workers[i]->Inbound(_n_workers);
+            worker_msg_t *msg = (worker_msg_t *) ring.Reserve(sizeof(worker_msg_t));
+            if (msg == nullptr) continue;
 
-    if (!_running) log_debug("stopped.\n");
-    else log_warn("stopped unexpectedly.\n");
-}
+            memset(msg, 0, sizeof(worker_msg_t));
+            msg->type = W_AGE;
+            ring.Commit();
+            posted[i] = true;
+        }
 
-void UdpDistributor::Scavenger () {
-    log_debug("Scavenger started.\n");
-    while (_running) {
-        std::unique_lock<std::mutex> lock (_scavenger_mtx);
-        infomap_t::iterator iit = _infos.begin();
-        while (iit != _infos.end()) {
-            if (!iit->second->IsAlive()) {
-                // client is gone, remove it.
-                port_t port = iit->first;
-                iit->second->Disconnect();
-                log_info("Client on port %" PRIport " seems to be dead, remove.\n", port);
-                Unplug(port);
-                clientsmap_t::const_iterator cit = _clients.find(InetSocketAddress(iit->second->AddrRef()));
-                if (cit == _clients.end()) {
-                    log_error("Try to remove client but port info missing in addr -> port mapping.\n");
-                } else _clients.erase(cit);
-                iit = _infos.erase(iit);
-            } else iit++;
+        for (size_t i = 0; i < _workers.size(); i++) {
+            if (!posted[i]) continue;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            _workers[i]->Wake();
+            posted[i] = false;
         }
-        if (_scavenger_cv.wait_for(lock, std::chrono::seconds(1)) != std::cv_status::timeout) break;
+
+        // only stop when asked to: a spurious wakeup must not end keepalives,
+        // ageing and buffer tuning.
+        if (_scavenger_cv.wait_for(lock, std::chrono::milliseconds(DIST_SCAVENGER_TICK), [this] { return !_running; })) break;
     }
     log_info("Scavenger stopped.\n");
 }
 
-void UdpDistributor::Send (port_t client, const uint8_t *buffer, size_t size) {
-    if (!_running) {
-        log_error("Send called but Distributor was not running.\n");
-        return;
-    }
-
-    infomap_t::const_iterator iit = _infos.find(client);
-
-    if (iit == _infos.end()) {
-        log_error("Send called on unknow port %" PRIport ".\n", client);
-        return;
-    }
-
-    iit->second->Write(buffer, size);
 }
-
-}
\ No newline at end of file
@@ -1,46 +1,51 @@
 #ifndef DIST_UDP_DIST_H
 #define DIST_UDP_DIST_H
-#include "switch.h"
 #include "vars.h"
 #include "types.h"
+#include "epoch.h"
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <stdint.h>
 #include <time.h>
 #include <vector>
 #include <thread>
-#include <memory>
 #include <mutex>
-#include <unordered_map>
 #include <condition_variable>
 #include <chrono>
+#include <atomic>
+#include <memory>
+#include <string>
 
 #define DIST_MAGIC 0x5EED
 
 namespace distributor {
 
-class InetSocketAddress {
-public:
-    InetSocketAddress ();
-    InetSocketAddress (const struct sockaddr_in &addr);
-    bool operator== (const InetSocketAddress &other) const;
-    size_t Hash() const;
-
-private:
-    struct sockaddr_in address;
-    size_t hash;
-};
-
-class InetSocketAddressHasher {
-public:
-    size_t operator() (const InetSocketAddress &key) const;
-};
-
+// per-client state. kept small since there is one for every connected
+// client: frames are queued to the shared EgressQueue, and control messages
+// are built on the stack. owned by the client's worker (ClientTable), and
+// read by scavenger.
 class Client {
 public:
-    Client (const struct sockaddr_in &address, int fd);
+    Client (const struct sockaddr_in &address, port_t port, int fd);
     const struct sockaddr_in& AddrRef () const;
     const struct sockaddr_in* AddrPtr () const;
+    port_t GetPort () const;
+
+    // get network of client. only valid if IsAssociated().
+    net_t GetNetwork () const;
+
+    // check if client is associated with a network.
+    bool IsAssociated () const;
+
+    // set network of client. index of client's port goes back to 0.
+    void SetNetwork (net_t net);
+
+    // get index of client's port in switch of its network (see
+    // SwitchCore::Plug()), 0 if not known yet.
+    port_index_t GetIndex () const;
+
+    // set index of client's port.
+    void SetIndex (port_index_t index);
 
     // send DISCONNECT to client
     ssize_t Disconnect ();
@@ -60,26 +65,34 @@ public:
     // update last_seen value.
     void Saw ();
 
-    // check if client is alive (might sent keepalive)
-    bool IsAlive ();
-
-    // write an ethrnet frame to client
-    ssize_t Write (const uint8_t *buffer, size_t size);
+    // check if client is alive at time now (might send keepalive). next is
+    // set to the time client should be checked again.
+    bool IsAlive (time_t now, time_t &next);
 
 private:
     // send a message with no payload
     ssize_t SendMsg (msg_type_t type);
 
     struct sockaddr_in _address;
-    time_t _last_seen;
-    time_t _last_sent;
-    uint8_t _send_buffer[DIST_CLIENT_SEND_BUFSZ];
+
+    // also read and written by scavenger.
+    std::atomic<time_t> _last_seen;
+    std::atomic<time_t> _last_sent;
+    port_t _port;
+    net_t _net;
+    port_index_t _index;
+    bool _associated;
     int _fd;
 };
 
-class UdpDistributor : private Switch {
+class UdpWorker;
+
+class UdpDistributor {
 public:
-    UdpDistributor(in_addr_t local_addr, in_port_t local_port);
+    // stats_path: path of a unix socket to serve stats on (see GetStats()),
+    // nullptr for none.
+    UdpDistributor(in_addr_t local_addr, in_port_t local_port, size_t batch_sz = DIST_WORKER_BATCH, size_t workers = DIST_WORKERS, bool uring = false, bool udp_offload = true, const char *stats_path = nullptr);
+    ~UdpDistributor();
 
     // Start the server
     void Start ();
@@ -90,30 +103,83 @@ public:
     // Join threads
     void Join ();
 
-    typedef std::unordered_map<InetSocketAddress, port_t, InetSocketAddressHasher> clientsmap_t;
-    typedef std::unordered_map<port_t, std::shared_ptr<Client>> infomap_t;
+    // Get average number of datagrams read per recvmmsg() call.
+    double GetBatchFill () const;
+
+    // Get number of messages read from sockets.
+    uint64_t GetRxMsgs () const;
+
+    // Get number of datagrams received (more than messages if GRO coalesced
+    // some of them).
+    uint64_t GetRxDatagrams () const;
+
+    // Get number of messages passed to kernel for sending.
+    uint64_t GetTxMsgs () const;
+
+    // Get number of datagrams sent (more than messages if GSO coalesced some
+    // of them).
+    uint64_t GetTxDatagrams () const;
+
+    // Get number of datagrams dropped by kernel because a worker's receive
+    // queue was full.
+    uint64_t GetKernelDrops () const;
+
+    // Get number of datagrams kernel did not take for sending.
+    uint64_t GetTxFailures () const;
+
+    // Append stats of every worker, its switch, networks and ports to out,
+    // as text lines ("<kind> <id> [key value]...").
+    void GetStats (std::string &out);
 
 private:
-    // Worker thread
-    void Worker ();
+    friend class UdpWorker;
+
+    // Get index of the worker that owns a network.
+    size_t Owner (net_t net) const;
+
+    // Allocate a port number for a new client.
+    port_t NextPort ();
 
     // Scavenger thread (send keepalive to unresponsive clients and disconnect 
-    // them if necessary)
+    // them if necessary). Every client has a timer in a timer wheel, so only
+    // clients that are due are checked. Also asks every worker to age its
+    // fdbs once per tick.
     void Scavenger ();
 
-    // inherited
-    void Send (port_t client, const uint8_t *buffer, size_t size);
+    // Get time (ms) to check client with key (ClientTable::Key()) that is due
+    // at t. Every client is delayed by its own offset (up to half the
+    // keepalive interval), so clients that connected together don't all get
+    // keepalives together.
+    uint64_t CheckTime (uint64_t key, uint64_t t) const;
+
+    // Create and bind stats socket. Return false on error.
+    bool OpenStats ();
+
+    // Stats thread: write GetStats() to every connection to stats socket,
+    // then close it.
+    void StatsServer ();
+
+    // epoch reader slots of threads that read clients of workers.
+    static const size_t SCAVENGER_READER = 0;
+    static const size_t CONTROL_READER = 1;
 
     in_port_t _local_port;
     in_addr_t _local_addr;
-    port_t _next_port;
-    int _fd;
-    clientsmap_t _clients;
-    infomap_t _infos;
-    bool _running;
+    std::atomic<port_t> _next_port;
+    size_t _batch_sz;
+    size_t _n_workers;
+    bool _uring;
+    bool _udp_offload;
+    EpochDomain _epoch;
+    std::vector<std::shared_ptr<UdpWorker>> _workers;
+    std::atomic<bool> _running;
     std::vector<std::thread> _threads;
+    std::thread _scavenger;
     std::mutex _scavenger_mtx;
     std::condition_variable _scavenger_cv;
+    std::string _stats_path;
+    int _stats_fd;
+    std::thread _stats;
 };
 
 }
@@ -0,0 +1,964 @@
+#include "udp-worker.h"
+#include "log.h"
+#include "clock.h"
+#include "vars.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+#include <netinet/udp.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <algorithm>
+#include <chrono>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif // UDP_SEGMENT
+
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif // UDP_GRO
+
+namespace distributor {
+
+// what control messages of a received message tell, 0 if not there.
+struct rx_meta {
+    size_t seg_sz;  // UDP_GRO segment size.
+    uint64_t rx_ns; // SCM_TIMESTAMPNS receive time.
+    uint32_t drops; // SO_RXQ_OVFL drops of socket so far.
+};
+
+static void read_cmsgs (struct msghdr *hdr, struct rx_meta &meta) {
+    memset(&meta, 0, sizeof(struct rx_meta));
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int sz;
+            memcpy(&sz, CMSG_DATA(cmsg), sizeof(int));
+            meta.seg_sz = sz > 0 ? (size_t) sz : 0;
+        } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(struct timespec));
+            meta.rx_ns = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+        } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+            memcpy(&meta.drops, CMSG_DATA(cmsg), sizeof(uint32_t));
+        }
+    }
+}
+
+UdpWorker::UdpWorker (UdpDistributor &dist, size_t index) : _dist(dist), _egress(DIST_EGRESS_BATCH), _infos(dist._epoch), _inbound(dist._n_workers + 1), _watch(DIST_WATCH_RING_SZ) {
+    _index = index;
+    _fd = -1;
+    _efd = -1;
+    _sleeping = false;
+    _gro = false;
+    _timestamps = false;
+    _rxq_ovfl = false;
+    _rxq_drops = 0;
+    _rcvbuf = 0;
+    _sndbuf = 0;
+    _rx_peak = 0;
+    _tx_peak = 0;
+    _tuned_drops = 0;
+    _tuned_tx_fails = 0;
+    _unsampled = 0;
+    _round_frames = 0;
+    _stats_req = false;
+    _stats_ready = false;
+    _stats_pos = 0;
+
+    _frame_hdr.magic = htons(DIST_MAGIC);
+    _frame_hdr.msg_type = M_ETHERNET_FRAME;
+
+    // one ring from scavenger now, rings from other workers on first use.
+    size_t n_workers = _dist._n_workers;
+    for (size_t i = 0; i < n_workers; i++) _inbound[i].store(nullptr, std::memory_order_relaxed);
+    _inbound[n_workers].store(new SpscRing(DIST_SCAVENGER_RING_SZ), std::memory_order_relaxed);
+    _notify.resize(n_workers, false);
+}
+
+UdpWorker::~UdpWorker () {
+    Close();
+
+    for (size_t i = 0; i < _inbound.size(); i++) delete _inbound[i].load();
+}
+
+bool UdpWorker::Open (const struct sockaddr_in &local, bool reuseport) {
+    _fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+
+    if (_fd < 0) {
+        log_fatal("socket(): %s\n", strerror(errno));
+        return false;
+    }
+
+    if (reuseport) {
+        int one = 1;
+        if (setsockopt(_fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+            log_fatal("setsockopt(SO_REUSEPORT): %s\n", strerror(errno));
+            Close();
+            return false;
+        }
+    }
+
+    int bind_ret = bind(_fd, (const struct sockaddr *) &local, sizeof(struct sockaddr_in));
+
+    if (bind_ret < 0) {
+        log_fatal("bind(): %s\n", strerror(errno));
+        Close();
+        return false;
+    }
+
+    if (_dist._udp_offload) {
+        // receive datagrams coalesced by kernel. their segment size comes in
+        // a control message.
+        int one = 1;
+        if (setsockopt(_fd, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0) {
+            log_warn("Worker %zu: UDP GRO not available: %s.\n", _index, strerror(errno));
+        } else _gro = true;
+
+        // probe for UDP_SEGMENT, it is set per message when sending.
+        int gso_sz;
+        socklen_t gso_sz_len = sizeof(int);
+        if (getsockopt(_fd, SOL_UDP, UDP_SEGMENT, &gso_sz, &gso_sz_len) < 0) {
+            log_warn("Worker %zu: UDP GSO not available: %s.\n", _index, strerror(errno));
+        } else _egress.SetGso(true);
+    }
+
+    if (DIST_LATENCY_SAMPLE > 0) {
+        // kernel receive time of every datagram, for latency stats.
+        int one = 1;
+        if (setsockopt(_fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) < 0) {
+            log_warn("Worker %zu: receive timestamps not available: %s.\n", _index, strerror(errno));
+        } else _timestamps = true;
+    }
+
+    // number of datagrams dropped on receive queue, with every datagram
+    // received after a drop.
+    int one = 1;
+    if (setsockopt(_fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) < 0) {
+        log_warn("Worker %zu: receive queue drop counts not available: %s.\n", _index, strerror(errno));
+    } else _rxq_ovfl = true;
+
+    // kernel reports twice the size set (it counts its bookkeeping).
+    int buf_sz;
+    socklen_t buf_sz_len = sizeof(int);
+    if (getsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &buf_sz, &buf_sz_len) == 0) _rcvbuf = buf_sz / 2;
+    buf_sz_len = sizeof(int);
+    if (getsockopt(_fd, SOL_SOCKET, SO_SNDBUF, &buf_sz, &buf_sz_len) == 0) _sndbuf = buf_sz / 2;
+    TuneBuffers();
+
+    _efd = eventfd(0, EFD_NONBLOCK);
+
+    if (_efd < 0) {
+        log_fatal("eventfd(): %s\n", strerror(errno));
+        Close();
+        return false;
+    }
+
+    _egress.SetFd(_fd);
+
+    return true;
+}
+
+void UdpWorker::Close () {
+    if (_fd >= 0) {
+        int close_ret = close(_fd);
+        if (close_ret < 0) log_error("close(): %s\n", strerror(errno));
+        _fd = -1;
+    }
+
+    if (_efd >= 0) {
+        close(_efd);
+        _efd = -1;
+    }
+}
+
+void UdpWorker::Run () {
+    log_debug("Worker %zu started, batch size %zu.\n", _index, _dist._batch_sz);
+
+    if (!_dist._uring || !RunUring()) RunSyscall();
+
+    log_debug("Worker %zu stopped.\n", _index);
+
+    SwitchCore::Reset();
+    _addrs.clear();
+    _infos.Clear();
+}
+
+void UdpWorker::RunSyscall () {
+    size_t batch_sz = _dist._batch_sz;
+    size_t slot_sz = _gro ? DIST_WORKER_GRO_SLOT_SZ : DIST_WORKER_SLOT_SZ;
+    size_t ctrl_sz = ControlSize();
+    std::vector<struct mmsghdr> msgs (batch_sz);
+    std::vector<struct iovec> iovs (batch_sz);
+    std::vector<struct sockaddr_in> addrs (batch_sz);
+    std::vector<uint8_t> slots (batch_sz * slot_sz);
+    std::vector<uint64_t> ctrls (batch_sz * ((ctrl_sz + sizeof(uint64_t) - 1) / sizeof(uint64_t)));
+
+    for (size_t i = 0; i < batch_sz; i++) {
+        iovs[i].iov_base = &slots[i * slot_sz];
+        iovs[i].iov_len = slot_sz;
+        memset(&msgs[i], 0, sizeof(struct mmsghdr));
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        if (ctrl_sz > 0) msgs[i].msg_hdr.msg_control = (uint8_t *) &ctrls[0] + i * ctrl_sz;
+    }
+
+    while (_dist._running) {
+        Clock::Tick();
+        size_t handled = ReadInbound();
+
+        for (size_t i = 0; i < batch_sz; i++) {
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            msgs[i].msg_hdr.msg_controllen = ctrl_sz;
+        }
+
+        log_logic("reading incoming packets...\n");
+        int n = recvmmsg(_fd, msgs.data(), batch_sz, MSG_DONTWAIT, NULL);
+
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            log_error("recvmmsg(): %s.\n", strerror(errno));
+        }
+
+        size_t datagrams = 0;
+
+        for (int i = 0; i < n; i++) {
+            const struct sockaddr_in &client_addr = addrs[i];
+
+            if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                log_warn("received packet from %s:%d too large (max %zu bytes).\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), slot_sz);
+                _counters->malformed.Add();
+                continue;
+            }
+
+            struct rx_meta meta;
+            read_cmsgs(&msgs[i].msg_hdr, meta);
+            if (meta.drops != 0) CountDrops(meta.drops);
+            datagrams += ReceiveSegments(client_addr, (const uint8_t *) iovs[i].iov_base, msgs[i].msg_len, meta.seg_sz, meta.rx_ns);
+        }
+
+        if (n > 0) CountBatch(n, datagrams);
+
+        EndRound();
+
+        if (handled == 0 && n <= 0) {
+            if (PrepareSleep()) {
+                struct pollfd fds[2];
+                fds[0].fd = _fd;
+                fds[0].events = POLLIN;
+                fds[1].fd = _efd;
+                fds[1].events = POLLIN;
+
+                int poll_ret = poll(fds, 2, -1);
+
+                if (poll_ret < 0 && errno != EINTR) {
+                    log_error("poll(): %s.\n", strerror(errno));
+                }
+
+                if (poll_ret > 0 && (fds[1].revents & POLLIN)) ClearWake();
+            }
+
+            _sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool UdpWorker::RunUring () {
+    // user_data of the requests we keep armed.
+    static const uint64_t RECV_TAG = 1;
+    static const uint64_t WAKE_TAG = 2;
+
+    size_t batch_sz = _dist._batch_sz;
+    unsigned n_bufs = 64;
+    while (n_bufs < batch_sz * 4) n_bufs <<= 1;
+
+    // buffer layout of multishot recvmsg: io_uring_recvmsg_out, source
+    // address, control messages, then payload.
+    size_t slot_sz = _gro ? DIST_WORKER_GRO_SLOT_SZ : DIST_WORKER_SLOT_SZ;
+    size_t ctrl_sz = ControlSize();
+    size_t name_off = sizeof(struct io_uring_recvmsg_out);
+    size_t ctrl_off = name_off + sizeof(struct sockaddr_in);
+    size_t payload_off = ctrl_off + ctrl_sz;
+
+    Uring uring;
+
+    if (!uring.Init(DIST_URING_ENTRIES, DIST_URING_ENTRIES * 8) || !uring.SetupBuffers(0, n_bufs, payload_off + slot_sz)) {
+        log_warn("Worker %zu: io_uring not available, using recvmmsg/sendmmsg.\n", _index);
+        return false;
+    }
+
+    struct msghdr recv_msg;
+    memset(&recv_msg, 0, sizeof(struct msghdr));
+    recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+    recv_msg.msg_controllen = ctrl_sz;
+
+    bool recv_armed = false;
+    bool wake_armed = false;
+    bool received = false;
+    std::vector<uint16_t> used_bufs;
+
+    _egress.SetUring(&uring);
+    log_info("Worker %zu: using io_uring.\n", _index);
+
+    while (_dist._running) {
+        Clock::Tick();
+
+        if (!recv_armed) {
+            struct io_uring_sqe *sqe = uring.GetSqe();
+            sqe->opcode = IORING_OP_RECVMSG;
+            sqe->fd = _fd;
+            sqe->addr = (uint64_t) (uintptr_t) &recv_msg;
+            sqe->len = 1;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = 0;
+            sqe->user_data = RECV_TAG;
+            recv_armed = true;
+        }
+
+        if (!wake_armed) {
+            struct io_uring_sqe *sqe = uring.GetSqe();
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = _efd;
+            sqe->poll32_events = POLLIN;
+            sqe->user_data = WAKE_TAG;
+            wake_armed = true;
+        }
+
+        size_t handled = ReadInbound();
+
+        uring.Submit(0);
+
+        size_t n = 0;
+        size_t datagrams = 0;
+        struct io_uring_cqe cqe;
+        while (n < batch_sz && uring.NextCqe(cqe)) {
+            if (cqe.user_data == WAKE_TAG) {
+                wake_armed = false;
+                ClearWake();
+                continue;
+            }
+
+            if (!(cqe.flags & IORING_CQE_F_MORE)) recv_armed = false;
+
+            if (cqe.res < 0) {
+                // out of buffers: re-armed once buffers are recycled.
+                if (cqe.res == -ENOBUFS) continue;
+
+                if (!received && (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP)) {
+                    log_warn("Worker %zu: multishot recvmsg not supported, using recvmmsg/sendmmsg.\n", _index);
+                    _egress.SetUring(nullptr);
+                    return false;
+                }
+
+                log_error("recvmsg(): %s.\n", strerror(-cqe.res));
+                continue;
+            }
+
+            if (!(cqe.flags & IORING_CQE_F_BUFFER)) continue;
+
+            uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+            uint8_t *buf = uring.Buffer(bid);
+            const struct io_uring_recvmsg_out *out = (const struct io_uring_recvmsg_out *) buf;
+            const struct sockaddr_in *client_addr = (const struct sockaddr_in *) (buf + name_off);
+
+            used_bufs.push_back(bid);
+            received = true;
+            n++;
+
+            if (out->flags & MSG_TRUNC) {
+                log_warn("received packet from %s:%d too large (max %zu bytes).\n", inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port), slot_sz);
+                _counters->malformed.Add();
+                continue;
+            }
+
+            struct msghdr ctrl;
+            memset(&ctrl, 0, sizeof(struct msghdr));
+            ctrl.msg_control = buf + ctrl_off;
+            ctrl.msg_controllen = out->controllen;
+
+            struct rx_meta meta;
+            read_cmsgs(&ctrl, meta);
+            if (meta.drops != 0) CountDrops(meta.drops);
+            datagrams += ReceiveSegments(*client_addr, buf + payload_off, out->payloadlen, meta.seg_sz, meta.rx_ns);
+        }
+
+        if (n > 0) CountBatch(n, datagrams);
+
+        EndRound();
+
+        // sends are complete, buffers can go back to kernel.
+        for (uint16_t bid : used_bufs) uring.RecycleBuffer(bid);
+        if (!used_bufs.empty()) uring.PublishBuffers();
+        used_bufs.clear();
+
+        if (handled == 0 && n == 0 && recv_armed && wake_armed) {
+            if (PrepareSleep() && !uring.HasCqe()) uring.Submit(1);
+            _sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    _egress.SetUring(nullptr);
+    return true;
+}
+
+size_t UdpWorker::ReadInbound () {
+    size_t batch_sz = _dist._batch_sz;
+    size_t handled = 0;
+
+    // messages from other workers and scavenger. read at most a batch from
+    // each ring so socket is not starved.
+    for (size_t i = 0; i < _inbound.size(); i++) {
+        SpscRing *inbound = _inbound[i].load(std::memory_order_acquire);
+        if (inbound == nullptr) continue;
+        SpscRing &ring = *inbound;
+        const uint8_t *rec;
+        size_t rec_sz;
+        for (size_t n = 0; n < batch_sz && (rec = ring.Read(rec_sz)) != nullptr; n++) {
+            const worker_msg_t *msg = (const worker_msg_t *) rec;
+            Dispatch(*msg, rec + sizeof(worker_msg_t), rec_sz - sizeof(worker_msg_t));
+            handled++;
+        }
+    }
+
+    if (!_backlog.empty() || !_watch_backlog.empty()) RetryBacklog();
+
+    return handled;
+}
+
+size_t UdpWorker::ControlSize () const {
+    size_t size = 0;
+    if (_gro) size += CMSG_SPACE(sizeof(int));
+    if (_timestamps) size += CMSG_SPACE(sizeof(struct timespec));
+    if (_rxq_ovfl) size += CMSG_SPACE(sizeof(uint32_t));
+    return size;
+}
+
+void UdpWorker::CountBatch (size_t msgs, size_t datagrams) {
+    _counters->rx_calls.Add();
+    _counters->rx_msgs.Add(msgs);
+    _counters->rx_datagrams.Add(datagrams);
+    if (datagrams > _rx_peak) _rx_peak = datagrams;
+}
+
+void UdpWorker::CountDrops (uint32_t drops) {
+    // counter of socket, wraps around.
+    uint32_t dropped = drops - _rxq_drops;
+    if (dropped == 0 || dropped >= 0x80000000U) return;
+
+    _counters->kernel_drops.Add(dropped);
+    _rxq_drops = drops;
+}
+
+void UdpWorker::TuneBuffers () {
+    const EgressQueue::egress_counters &tx = _egress.Counters();
+    uint64_t drops = _counters->kernel_drops.Get();
+    uint64_t tx_fails = tx.no_buffer.Get() + tx.would_block.Get();
+
+    size_t rcvbuf = (2 * _rx_peak + DIST_SOCK_BUF_CLIENT * _infos.Size()) * DIST_SOCK_BUF_DGRAM;
+    size_t sndbuf = (2 * _tx_peak + DIST_SOCK_BUF_CLIENT * PortCount()) * DIST_SOCK_BUF_DGRAM;
+
+    // kernel ran out of room since last time, whatever the estimate says.
+    if (drops != _tuned_drops) rcvbuf = std::max(rcvbuf, 2 * _rcvbuf);
+    if (tx_fails != _tuned_tx_fails) sndbuf = std::max(sndbuf, 2 * _sndbuf);
+
+    _rcvbuf = GrowBuffer(SO_RCVBUF, SO_RCVBUFFORCE, _rcvbuf, rcvbuf, "receive");
+    _sndbuf = GrowBuffer(SO_SNDBUF, SO_SNDBUFFORCE, _sndbuf, sndbuf, "send");
+
+    _tuned_drops = drops;
+    _tuned_tx_fails = tx_fails;
+    _rx_peak = 0;
+    _tx_peak = 0;
+}
+
+size_t UdpWorker::GrowBuffer (int opt, int force_opt, size_t cur, size_t want, const char *name) {
+    want = std::min(std::max(want, (size_t) DIST_SOCK_BUF_MIN), (size_t) DIST_SOCK_BUF_MAX);
+    if (want <= cur) return cur;
+
+    // forced size is not capped by net.core.rmem_max/wmem_max, but needs
+    // CAP_NET_ADMIN.
+    int val = (int) want;
+    if (setsockopt(_fd, SOL_SOCKET, force_opt, &val, sizeof(int)) < 0 && setsockopt(_fd, SOL_SOCKET, opt, &val, sizeof(int)) < 0) {
+        log_warn("Worker %zu: can't set %s buffer size: %s.\n", _index, name, strerror(errno));
+        return want;
+    }
+
+    int got = 0;
+    socklen_t got_len = sizeof(int);
+    getsockopt(_fd, SOL_SOCKET, opt, &got, &got_len);
+    log_info("Worker %zu: %s buffer is now %d bytes (asked for %zu).\n", _index, name, got / 2, want);
+
+    // not asked again for this size if capped by system limit.
+    return want;
+}
+
+size_t UdpWorker::ReceiveSegments (const struct sockaddr_in &client_addr, const uint8_t *buffer, size_t len, size_t seg_sz, uint64_t rx_ns) {
+    if (seg_sz == 0 || seg_sz >= len) {
+        Receive(client_addr, buffer, len, rx_ns);
+        return 1;
+    }
+
+    size_t n = 0;
+    for (size_t off = 0; off < len; off += seg_sz) {
+        Receive(client_addr, buffer + off, std::min(seg_sz, len - off), rx_ns);
+        n++;
+    }
+
+    return n;
+}
+
+void UdpWorker::EndRound () {
+    // send everything forwarded in this round. queued frames point into the
+    // receive buffers and inbound rings, so this must be done before they
+    // are reused.
+    size_t queued = _egress.Pending();
+    _egress.Flush();
+    if (queued > _tx_peak) _tx_peak = queued;
+
+    if (!_samples.empty()) RecordLatency();
+    _round_frames = 0;
+
+    for (size_t i = 0; i < _inbound.size(); i++) {
+        SpscRing *ring = _inbound[i].load(std::memory_order_acquire);
+        if (ring != nullptr) ring->Release();
+    }
+
+    Notify();
+    _infos.Collect();
+
+    if (_stats_req.load(std::memory_order_relaxed)) AnswerStats();
+}
+
+void UdpWorker::RecordLatency () {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t now = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    size_t batch = BatchClass(_round_frames);
+
+    for (const struct latency_sample &sample : _samples) {
+        // clock stepped back.
+        if (sample.rx_ns > now) continue;
+        _latency[sample.flooded][batch].Record(now - sample.rx_ns);
+    }
+
+    _samples.clear();
+}
+
+size_t UdpWorker::BatchClass (size_t frames) {
+    size_t batch = 0;
+    while (frames > 1 && batch < BATCH_CLASSES - 1) {
+        frames >>= 1;
+        batch++;
+    }
+
+    return batch;
+}
+
+void UdpWorker::AnswerStats () {
+    if (_stats_pos == 0) {
+        const struct worker_counters &c = *_counters;
+        const EgressQueue::egress_counters &tx = _egress.Counters();
+        struct worker_stats &w = _stats_worker;
+
+        w.clients = _infos.Size();
+        w.rx_calls = c.rx_calls.Get();
+        w.rx_msgs = c.rx_msgs.Get();
+        w.rx_datagrams = c.rx_datagrams.Get();
+        w.tx_msgs = tx.messages.Get();
+        w.tx_datagrams = tx.datagrams.Get();
+        w.malformed = c.malformed.Get();
+        w.need_association = c.need_association.Get();
+        w.new_clients = c.new_clients.Get();
+        w.ring_drops = c.ring_drops.Get();
+        w.kernel_drops = c.kernel_drops.Get();
+        w.tx_no_buffer = tx.no_buffer.Get();
+        w.tx_would_block = tx.would_block.Get();
+        w.tx_failed = tx.failed.Get();
+        w.rcvbuf = 0;
+        w.sndbuf = 0;
+
+        socklen_t buf_sz_len = sizeof(int);
+        getsockopt(_fd, SOL_SOCKET, SO_RCVBUF, &w.rcvbuf, &buf_sz_len);
+        buf_sz_len = sizeof(int);
+        getsockopt(_fd, SOL_SOCKET, SO_SNDBUF, &w.sndbuf, &buf_sz_len);
+    }
+
+    // big switches are copied over several rounds.
+    if (!SnapshotStats(_stats_snap, _stats_pos, DIST_STATS_PORTS)) return;
+
+    std::lock_guard<std::mutex> lock (_stats_mtx);
+    _stats_ready = true;
+    _stats_req.store(false, std::memory_order_relaxed);
+    _stats_cv.notify_all();
+}
+
+bool UdpWorker::Stats (std::string &out) {
+    std::unique_lock<std::mutex> lock (_stats_mtx);
+    _stats_ready = false;
+
+    // pairs with the fence in PrepareSleep(): either we see the worker
+    // sleeping, or it sees the request.
+    _stats_req.store(true);
+    Wake();
+
+    if (!_stats_cv.wait_for(lock, std::chrono::milliseconds(DIST_STATS_TIMEOUT), [this] { return _stats_ready; })) return false;
+
+    // worker leaves the answer alone until next request.
+    char line[512];
+    const struct worker_stats &w = _stats_worker;
+
+    snprintf(line, sizeof(line), "worker %zu clients %zu rx_calls %" PRIu64 " rx_messages %" PRIu64 " rx_datagrams %" PRIu64 " tx_messages %" PRIu64 " tx_datagrams %" PRIu64 " malformed %" PRIu64 " need_association %" PRIu64 " new_clients %" PRIu64 " ring_drops %" PRIu64 "\n",
+        _index, w.clients, w.rx_calls, w.rx_msgs, w.rx_datagrams, w.tx_msgs, w.tx_datagrams, w.malformed, w.need_association, w.new_clients, w.ring_drops);
+    out += line;
+
+    // capacity: kernel drops and send failures, and socket buffers (as
+    // reported by kernel).
+    snprintf(line, sizeof(line), "socket %zu kernel_drops %" PRIu64 " tx_no_buffer %" PRIu64 " tx_would_block %" PRIu64 " tx_failed %" PRIu64 " rcvbuf %d sndbuf %d\n",
+        _index, w.kernel_drops, w.tx_no_buffer, w.tx_would_block, w.tx_failed, w.rcvbuf, w.sndbuf);
+    out += line;
+    WriteStats(out, _index, _stats_snap);
+    return true;
+}
+
+void UdpWorker::Wake () {
+    if (_sleeping.load()) {
+        uint64_t one = 1;
+        ssize_t w_ret = write(_efd, &one, sizeof(uint64_t));
+        if (w_ret < 0 && errno != EAGAIN) log_error("write(): %s.\n", strerror(errno));
+    }
+}
+
+SpscRing& UdpWorker::Inbound (size_t producer) {
+    SpscRing *ring = _inbound[producer].load(std::memory_order_acquire);
+    if (ring != nullptr) return *ring;
+
+    // only producer stores it, the ring is complete before we see it.
+    ring = new SpscRing(DIST_WORKER_RING_SZ);
+    _inbound[producer].store(ring, std::memory_order_release);
+    return *ring;
+}
+
+void UdpWorker::Receive (const struct sockaddr_in &client_addr, const uint8_t *buffer, size_t len, uint64_t rx_ns) {
+    log_logic("Packet from %s:%d.\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+
+    if (len == 0) {
+        log_error("received empty packet.\n");
+        _counters->malformed.Add();
+        return;
+    }
+
+    if (len < sizeof(dist_header_t)) {
+        log_warn("received packet too small.\n");
+        _counters->malformed.Add();
+        return;
+    }
+
+    const dist_header_t *msg_hdr = (const dist_header_t *) buffer;
+
+    if (ntohs(msg_hdr->magic) != DIST_MAGIC) {
+        log_warn("received invalid packet from %s:%d (Invalid magic).\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+        _counters->malformed.Add();
+        return;
+    }
+
+    // find/create client info
+    uint64_t key = ClientTable::Key(client_addr);
+    Client *info = _infos.Find(key);
+    if (info == nullptr) {
+        log_debug("Client info for %s:%d does not exist, creating...\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+        port_t port = _dist.NextPort();
+
+        info = new Client(client_addr, port, _fd);
+        _infos.Insert(info);
+
+        info->Associate();
+        _counters->new_clients.Add();
+        _counters->need_association.Add();
+        Watch(key, port);
+        log_info("New client from %s:%d, assigned port: %" PRIport ".\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), port);
+    }
+
+    Client &client = *info;
+    port_t port = client.GetPort();
+    size_t msg_len = (size_t) len - sizeof(dist_header_t);
+    const uint8_t *msg_ptr = buffer + sizeof(dist_header_t);
+
+    worker_msg_t msg;
+    memset(&msg, 0, sizeof(worker_msg_t));
+    msg.port = port;
+    msg.address = client_addr;
+    msg.worker = (uint16_t) _index;
+
+    // now we have complete picture of who client is, process client's message
+    switch (msg_hdr->msg_type) {
+        case M_ETHERNET_FRAME:
+            log_logic("Got M_ETHERNET_FRAME from client on port %" PRIport ".\n", port);
+            if (!client.IsAssociated()) {
+                log_info("Sending associate request to client on port %" PRIport ".\n", port);
+                client.Associate();
+                _counters->need_association.Add();
+                break;
+            }
+            msg.type = W_FRAME;
+            msg.net = client.GetNetwork();
+            msg.index = client.GetIndex();
+            if (rx_ns != 0 && ++_unsampled == DIST_LATENCY_SAMPLE) {
+                msg.rx_ns = rx_ns;
+                _unsampled = 0;
+            }
+            Post(_dist.Owner(msg.net), msg, msg_ptr, msg_len);
+            break;
+        case M_ASSOCIATE_REQUEST: {
+            log_logic("Got M_ASSOCIATE_REQUEST from client on port %" PRIport ".\n", port);
+            if (msg_len != sizeof(net_t)) {
+                log_warn("Invalid ASSOCIATE_REQUEST message from client on port %" PRIport ". (len = %zu)\n", port, msg_len);
+                _counters->malformed.Add();
+                break;
+            }
+            net_t net = ntohl(*(const net_t *) msg_ptr);
+            log_info("Associating client on port %" PRIport " with network %" PRInet ".\n", port, net);
+
+            // moving to a network owned by another worker, unplug from old one
+            // first. (if owner is the same, Plug() takes care of it)
+            if (client.IsAssociated() && _dist.Owner(client.GetNetwork()) != _dist.Owner(net)) {
+                msg.type = W_UNPLUG;
+                msg.net = client.GetNetwork();
+                Post(_dist.Owner(msg.net), msg, nullptr, 0);
+            }
+
+            client.SetNetwork(net);
+            msg.type = W_PLUG;
+            msg.net = net;
+            Post(_dist.Owner(net), msg, nullptr, 0);
+            client.AckAssociate();
+            break;
+        }
+        case M_KEEPALIVE_REQUEST:
+            log_logic("Got M_KEEPALIVE_REQUEST from client on port %" PRIport ".\n", port);
+            client.AckKeepalive();
+            break;
+        case M_KEEPALIVE_RESPOND:
+            log_logic("Got M_KEEPALIVE_RESPOND from client on port %" PRIport ".\n", port);
+            break;
+        case M_DISCONNECT: {
+            log_logic("Got M_DISCONNECT from client on port %" PRIport ".\n", port);
+            log_info("Got disconnect request from client on port %" PRIport ", unregister client.\n", port);
+            Remove(client);
+            return;
+        }
+        default:
+            log_warn("Invalid message type %d from client on port %" PRIport ".\n", msg_hdr->msg_type, port);
+            _counters->malformed.Add();
+            return;
+    }
+
+    // "return" not called (i.e. valid msg from client, update last seen.)
+    log_logic("Updating last seen for client on port %" PRIport ".\n", port);
+    client.Saw();
+}
+
+void UdpWorker::Dispatch (const worker_msg_t &msg, const uint8_t *frame, size_t size) {
+    switch (msg.type) {
+        case W_FRAME:
+            if (!Forward(msg.index, msg.port, frame, size)) {
+                log_info("Sending associate request to client on port %" PRIport ".\n", msg.port);
+                Client(msg.address, msg.port, _fd).Associate();
+                _counters->need_association.Add();
+                break;
+            }
+
+            _round_frames++;
+
+            if (msg.rx_ns != 0) {
+                struct latency_sample sample;
+                sample.rx_ns = msg.rx_ns;
+                sample.flooded = Flooded();
+                _samples.push_back(sample);
+            }
+            break;
+        case W_PLUG: {
+            port_index_t index = Plug(msg.net, msg.port);
+            if (index >= _addrs.size()) _addrs.resize(index + 1);
+            _addrs[index] = msg.address;
+
+            // tell client's worker, so its frames skip the port lookup.
+            worker_msg_t reply = msg;
+            reply.type = W_INDEX;
+            reply.index = index;
+            Post(msg.worker, reply, nullptr, 0);
+            break;
+        }
+        case W_UNPLUG:
+            Unplug(msg.port);
+            break;
+        case W_INDEX: {
+            Client *client = _infos.Find(ClientTable::Key(msg.address));
+
+            // client gone, or moved to another network since.
+            if (client == nullptr || client->GetPort() != msg.port || !client->IsAssociated() || client->GetNetwork() != msg.net) break;
+            client->SetIndex(msg.index);
+            break;
+        }
+        case W_EXPIRE: {
+            Client *client = _infos.Find(ClientTable::Key(msg.address));
+            if (client == nullptr || client->GetPort() != msg.port) {
+                log_debug("Client on port %" PRIport " already removed.\n", msg.port);
+                break;
+            }
+            Remove(*client);
+            break;
+        }
+        case W_AGE:
+            AgeFdbs(DIST_FDB_AGE_BUDGET);
+            TuneBuffers();
+            break;
+        default:
+            log_error("Invalid worker message type %d.\n", msg.type);
+            break;
+    }
+}
+
+bool UdpWorker::Post (size_t owner, const worker_msg_t &msg, const uint8_t *frame, size_t size) {
+    if (owner == _index) {
+        Dispatch(msg, frame, size);
+        return true;
+    }
+
+    // keep control messages in order: if some are still waiting for space,
+    // frames are dropped and new control messages wait behind them.
+    bool blocked = false;
+    for (const std::pair<size_t, worker_msg_t> &pending : _backlog) {
+        if (pending.first == owner) {
+            blocked = true;
+            break;
+        }
+    }
+
+    SpscRing &ring = _dist._workers[owner]->Inbound(_index);
+    uint8_t *rec = blocked ? nullptr : ring.Reserve(sizeof(worker_msg_t) + size);
+
+    if (rec == nullptr) {
+        if (msg.type == W_FRAME) {
+            log_debug("Ring to worker %zu full, dropping frame.\n", owner);
+            _counters->ring_drops.Add();
+            return false;
+        }
+
+        _backlog.push_back(std::make_pair(owner, msg));
+        return true;
+    }
+
+    memcpy(rec, &msg, sizeof(worker_msg_t));
+    if (size > 0) memcpy(rec + sizeof(worker_msg_t), frame, size);
+    ring.Commit();
+    _notify[owner] = true;
+
+    return true;
+}
+
+void UdpWorker::Watch (uint64_t key, port_t port) {
+    watch_msg_t msg;
+    msg.key = key;
+    msg.port = port;
+
+    uint8_t *rec = _watch_backlog.empty() ? _watch.Reserve(sizeof(watch_msg_t)) : nullptr;
+
+    if (rec == nullptr) {
+        _watch_backlog.push_back(msg);
+        return;
+    }
+
+    memcpy(rec, &msg, sizeof(watch_msg_t));
+    _watch.Commit();
+}
+
+void UdpWorker::RetryBacklog () {
+    size_t watched = 0;
+    for (; watched < _watch_backlog.size(); watched++) {
+        uint8_t *rec = _watch.Reserve(sizeof(watch_msg_t));
+        if (rec == nullptr) break;
+        memcpy(rec, &_watch_backlog[watched], sizeof(watch_msg_t));
+        _watch.Commit();
+    }
+    _watch_backlog.erase(_watch_backlog.begin(), _watch_backlog.begin() + watched);
+
+    while (!_backlog.empty()) {
+        const std::pair<size_t, worker_msg_t> &pending = _backlog.front();
+        SpscRing &ring = _dist._workers[pending.first]->Inbound(_index);
+        uint8_t *rec = ring.Reserve(sizeof(worker_msg_t));
+
+        if (rec == nullptr) break;
+
+        memcpy(rec, &pending.second, sizeof(worker_msg_t));
+        ring.Commit();
+        _notify[pending.first] = true;
+        _backlog.pop_front();
+    }
+}
+
+void UdpWorker::Notify () {
+    bool fenced = false;
+
+    for (size_t i = 0; i < _notify.size(); i++) {
+        if (!_notify[i]) continue;
+
+        // pairs with the fence in Sleep(): either we see the worker sleeping,
+        // or it sees our messages.
+        if (!fenced) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            fenced = true;
+        }
+
+        _dist._workers[i]->Wake();
+        _notify[i] = false;
+    }
+}
+
+bool UdpWorker::PrepareSleep () {
+    _sleeping.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (!_dist._running || !_backlog.empty() || !_watch_backlog.empty() || _stats_req.load()) return false;
+
+    for (size_t i = 0; i < _inbound.size(); i++) {
+        SpscRing *ring = _inbound[i].load(std::memory_order_acquire);
+        if (ring != nullptr && !ring->Empty()) return false;
+    }
+
+    return true;
+}
+
+void UdpWorker::ClearWake () {
+    uint64_t val;
+    if (read(_efd, &val, sizeof(uint64_t)) < 0 && errno != EAGAIN) {
+        log_error("read(): %s.\n", strerror(errno));
+    }
+}
+
+void UdpWorker::Remove (Client &client) {
+    port_t port = client.GetPort();
+
+    if (client.IsAssociated()) {
+        worker_msg_t msg;
+        memset(&msg, 0, sizeof(worker_msg_t));
+        msg.type = W_UNPLUG;
+        msg.port = port;
+        msg.net = client.GetNetwork();
+        msg.address = client.AddrRef();
+        Post(_dist.Owner(msg.net), msg, nullptr, 0);
+    }
+
+    // freed once scavenger can't be looking at it.
+    _infos.Remove(ClientTable::Key(client.AddrRef()));
+}
+
+void UdpWorker::Send (port_index_t index, port_t, const uint8_t *buffer, size_t size) {
+    _egress.Queue(_addrs[index], _frame_hdr, buffer, size);
+}
+
+}
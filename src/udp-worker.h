@@ -0,0 +1,288 @@
+#ifndef DIST_UDP_WORKER_H
+#define DIST_UDP_WORKER_H
+#include "udp-distributor.h"
+#include "client-table.h"
+#include "switch-core.h"
+#include "egress.h"
+#include "ring.h"
+#include "stats.h"
+#include "histogram.h"
+#include "types.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+
+namespace distributor {
+
+// type of messages passed to a worker through its inbound rings.
+enum worker_msg_type {
+    W_FRAME = 0,  // ethernet frame from client, sent to owner of the network.
+    W_PLUG = 1,   // plug client into network, sent to owner of the network.
+    W_UNPLUG = 2, // unplug client, sent to owner of the network.
+    W_EXPIRE = 3, // remove dead client, sent by scavenger to client's worker.
+    W_AGE = 4,    // age fdb entries, sent by scavenger to every worker each tick.
+    W_INDEX = 5   // index of a plugged port, sent by owner to client's worker.
+};
+
+// message header. W_FRAME message is followed by the ethernet frame, rx_ns
+// is its kernel receive time (ns, CLOCK_REALTIME) if sampled for latency
+// stats, 0 otherwise. index is the port index of the client in owner's
+// switch (W_FRAME: as last known, 0 if not known; W_INDEX: as plugged).
+// worker is the worker of the client.
+struct worker_msg {
+    port_t port;
+    struct sockaddr_in address;
+    net_t net;
+    port_index_t index;
+    uint16_t worker;
+    uint8_t type;
+    uint64_t rx_ns;
+};
+
+typedef struct worker_msg worker_msg_t;
+
+// record of watch ring: a new client, passed to scavenger.
+struct watch_msg {
+    uint64_t key;
+    port_t port;
+};
+
+typedef struct watch_msg watch_msg_t;
+
+// UdpWorker: one forwarding thread and its socket.
+//
+// Every worker binds its own SO_REUSEPORT socket, so kernel always steers
+// datagrams of a client to the same worker, and that worker alone owns the
+// client's state. Every network is owned by exactly one worker
+// (UdpDistributor::Owner()), which alone runs the switch (ports, FDB) for
+// that network. Frames from a client on a network owned by another worker
+// are copied into a single-producer ring of the owner.
+class UdpWorker : private SwitchCore<UdpWorker> {
+public:
+    UdpWorker (UdpDistributor &dist, size_t index);
+    ~UdpWorker ();
+
+    // Create and bind worker socket. Return false on error.
+    bool Open (const struct sockaddr_in &local, bool reuseport);
+
+    // Close worker socket.
+    void Close ();
+
+    // Worker thread.
+    void Run ();
+
+    // Wake the worker if it is waiting for packets.
+    void Wake ();
+
+    // Get the ring for messages from producer (worker index, or number of
+    // workers for scavenger). Ring of a worker is created by its first call,
+    // so must only be called by the producer.
+    SpscRing& Inbound (size_t producer);
+
+    // Append stats of worker and its switch to out (see
+    // SwitchCore::WriteStats()). Counters are copied by the worker thread at
+    // the end of its rounds, DIST_STATS_PORTS ports per round, and formatted
+    // by the caller; return false if the worker did not answer within
+    // DIST_STATS_TIMEOUT ms. Called by one thread at a time.
+    bool Stats (std::string &out);
+
+private:
+    friend class UdpDistributor;
+    friend class SwitchCore<UdpWorker>;
+
+    // Worker loop, recvmmsg()/sendmmsg() backend.
+    void RunSyscall ();
+
+    // Worker loop, io_uring backend. Return false if io_uring can't be used.
+    bool RunUring ();
+
+    // Dispatch messages from inbound rings, return number of messages.
+    size_t ReadInbound ();
+
+    // Get size of control message buffer for one received message.
+    size_t ControlSize () const;
+
+    // Update receive stats: msgs messages read from socket in one batch,
+    // holding datagrams datagrams.
+    void CountBatch (size_t msgs, size_t datagrams);
+
+    // Update kernel drop count from SO_RXQ_OVFL value of a message (drops of
+    // socket so far).
+    void CountDrops (uint32_t drops);
+
+    // Grow socket buffers if bursts, clients, kernel drops or send failures
+    // seen since last call need it. Called every scavenger tick.
+    void TuneBuffers ();
+
+    // Set socket buffer option opt (force_opt to go over system limit if
+    // allowed) to want bytes, within DIST_SOCK_BUF_MIN and DIST_SOCK_BUF_MAX,
+    // if more than cur. Return new size asked for.
+    size_t GrowBuffer (int opt, int force_opt, size_t cur, size_t want, const char *name);
+
+    // Process a message from socket, which holds seg_sz sized datagrams
+    // coalesced by GRO (or one datagram if seg_sz is 0), received at rx_ns
+    // (0 if not timestamped). Return number of datagrams.
+    size_t ReceiveSegments (const struct sockaddr_in &client_addr, const uint8_t *buffer, size_t len, size_t seg_sz, uint64_t rx_ns);
+
+    // Flush egress queue, give ring space back and wake workers we posted to.
+    // Records latency of sampled frames and answers stats request if there is
+    // one.
+    void EndRound ();
+
+    // Record latency of frames sampled in this round, now that they are sent.
+    void RecordLatency ();
+
+    // Get latency histogram class of a round that forwarded frames frames.
+    static size_t BatchClass (size_t frames);
+
+    // Copy counters for Stats(), hand them over once every port is copied.
+    void AnswerStats ();
+
+    // Process one datagram received from client at rx_ns.
+    void Receive (const struct sockaddr_in &client_addr, const uint8_t *buffer, size_t len, uint64_t rx_ns);
+
+    // Process one message from inbound ring.
+    void Dispatch (const worker_msg_t &msg, const uint8_t *frame, size_t size);
+
+    // Pass a message to worker owner. Dispatched right away if this worker is
+    // the owner. Return false if message was dropped.
+    bool Post (size_t owner, const worker_msg_t &msg, const uint8_t *frame, size_t size);
+
+    // Pass a new client (key and port) to scavenger, to start its liveness
+    // timer.
+    void Watch (uint64_t key, port_t port);
+
+    // Retry control messages and new clients that did not fit in rings.
+    void RetryBacklog ();
+
+    // Wake other workers we posted to.
+    void Notify ();
+
+    // Mark worker as sleeping. Return false if there is still work to do.
+    bool PrepareSleep ();
+
+    // Reset wakeup eventfd.
+    void ClearWake ();
+
+    // Remove a client, unplug it from its network.
+    void Remove (Client &client);
+
+    // called by SwitchCore
+    void Send (port_index_t index, port_t client, const uint8_t *buffer, size_t size);
+
+    UdpDistributor &_dist;
+    size_t _index;
+    int _fd;
+    int _efd;
+    dist_header_t _frame_hdr;
+    EgressQueue _egress;
+
+    // clients steered to this worker by kernel.
+    ClientTable _infos;
+
+    // address of every port plugged into networks owned by this worker, by
+    // port index.
+    std::vector<struct sockaddr_in> _addrs;
+
+    // inbound rings, indexed by producer. rings from workers are created by
+    // the producer when it first posts to us (nullptr before), so memory
+    // grows with pairs of workers that talk, not with the square of workers.
+    std::vector<std::atomic<SpscRing *>> _inbound;
+
+    // control messages waiting for space in other workers' rings.
+    std::deque<std::pair<size_t, worker_msg_t>> _backlog;
+
+    // new clients for scavenger, and ones that did not fit in it.
+    SpscRing _watch;
+    std::vector<watch_msg_t> _watch_backlog;
+
+    // workers we posted to since last Notify().
+    std::vector<bool> _notify;
+
+    std::atomic<bool> _sleeping;
+
+    // socket receives GRO coalesced datagrams, receive timestamps and
+    // receive queue drop counts.
+    bool _gro;
+    bool _timestamps;
+    bool _rxq_ovfl;
+
+    // last SO_RXQ_OVFL drop count of socket.
+    uint32_t _rxq_drops;
+
+    // socket buffer sizes asked for, largest number of datagrams received
+    // and sent in one round since last TuneBuffers(), and kernel drops and
+    // send failures seen by it.
+    size_t _rcvbuf;
+    size_t _sndbuf;
+    size_t _rx_peak;
+    size_t _tx_peak;
+    uint64_t _tuned_drops;
+    uint64_t _tuned_tx_fails;
+
+    // frames seen since last one sampled for latency.
+    uint32_t _unsampled;
+
+    // frames forwarded in this round, and receive time of sampled ones.
+    struct latency_sample {
+        uint64_t rx_ns;
+        bool flooded;
+    };
+
+    size_t _round_frames;
+    std::vector<struct latency_sample> _samples;
+
+    // number of classes of rounds by frames forwarded: 1, 2-3, 4-7, ... 64+.
+    static const size_t BATCH_CLASSES = 7;
+
+    // forwarding latency (ns) by unicast/flooded, and frames forwarded in
+    // the same round.
+    Histogram _latency[2][BATCH_CLASSES];
+
+    // receive batch stats, datagrams dropped by kernel (receive queue full),
+    // frames dropped because owner's ring was full, datagrams dropped as
+    // malformed, NEED_ASSOCIATION sent and clients created. written by worker
+    // only.
+    struct worker_counters {
+        Counter rx_calls;
+        Counter rx_msgs;
+        Counter rx_datagrams;
+        Counter kernel_drops;
+        Counter ring_drops;
+        Counter malformed;
+        Counter need_association;
+        Counter new_clients;
+    };
+
+    Padded<struct worker_counters> _counters;
+
+    // counters of worker and its socket, copied by AnswerStats().
+    struct worker_stats {
+        size_t clients;
+        uint64_t rx_calls, rx_msgs, rx_datagrams, tx_msgs, tx_datagrams;
+        uint64_t malformed, need_association, new_clients, ring_drops;
+        uint64_t kernel_drops, tx_no_buffer, tx_would_block, tx_failed;
+        int rcvbuf, sndbuf;
+    };
+
+    // stats request (set by Stats(), cleared by worker), and the answer:
+    // written by worker until ready, then read by Stats(). position of the
+    // next port to copy.
+    std::atomic<bool> _stats_req;
+    std::mutex _stats_mtx;
+    std::condition_variable _stats_cv;
+    bool _stats_ready;
+    struct worker_stats _stats_worker;
+    struct stats_snapshot _stats_snap;
+    size_t _stats_pos;
+};
+
+}
+
+#endif // DIST_UDP_WORKER_H
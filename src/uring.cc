@@ -0,0 +1,302 @@
+#include "uring.h"
+#include "log.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <algorithm>
+
+namespace distributor {
+
+static int io_uring_setup (unsigned entries, struct io_uring_params *p) {
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter (int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+Uring::Uring () {
+    _fd = -1;
+    _sq_ptr = MAP_FAILED;
+    _cq_ptr = MAP_FAILED;
+    _sqes = (struct io_uring_sqe *) MAP_FAILED;
+    _bufs = nullptr;
+    _sq_sz = _sqes_sz = 0;
+    _sq_local_tail = 0;
+    _sq_entries = 0;
+    _buf_sz = 0;
+    _buf_count = 0;
+    _bgid = 0;
+}
+
+Uring::~Uring () {
+    Close();
+}
+
+bool Uring::Init (unsigned sq_entries, unsigned cq_entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(struct io_uring_params));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = cq_entries;
+
+    _fd = io_uring_setup(sq_entries, &p);
+
+    if (_fd < 0) {
+        log_warn("io_uring_setup(): %s.\n", strerror(errno));
+        return false;
+    }
+
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_NODROP)) {
+        log_warn("io_uring of this kernel is too old.\n");
+        Close();
+        return false;
+    }
+
+    // sq and cq rings share one mapping (IORING_FEAT_SINGLE_MMAP).
+    _sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (cq_sz > _sq_sz) _sq_sz = cq_sz;
+
+    _sq_ptr = mmap(NULL, _sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_sq_ptr == MAP_FAILED) {
+        log_warn("mmap(): %s.\n", strerror(errno));
+        Close();
+        return false;
+    }
+    _cq_ptr = _sq_ptr;
+
+    _sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    _sqes = (struct io_uring_sqe *) mmap(NULL, _sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    if (_sqes == MAP_FAILED) {
+        log_warn("mmap(): %s.\n", strerror(errno));
+        Close();
+        return false;
+    }
+
+    uint8_t *sq = (uint8_t *) _sq_ptr;
+    _sq_head = (unsigned *) (sq + p.sq_off.head);
+    _sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    _sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    _sq_array = (unsigned *) (sq + p.sq_off.array);
+    _sq_local_tail = *_sq_tail;
+    _sq_entries = p.sq_entries;
+
+    uint8_t *cq = (uint8_t *) _cq_ptr;
+    _cq_head = (unsigned *) (cq + p.cq_off.head);
+    _cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    _cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    _cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+    return true;
+}
+
+bool Uring::SetupBuffers (uint16_t bgid, unsigned count, size_t size) {
+    _buf_sz = size;
+    _buf_count = count;
+    _bgid = bgid;
+    _bufs = new uint8_t[count * size];
+
+    for (unsigned i = 0; i < count; i++) RecycleBuffer(i);
+    PublishBuffers();
+    Submit(0);
+
+    // wait for buffers to be accepted, so an old kernel fails here rather
+    // than on first receive.
+    struct io_uring_cqe cqe;
+    while (!PeekCqe(cqe, true)) Submit(1);
+
+    if (cqe.res < 0) {
+        log_warn("IORING_OP_PROVIDE_BUFFERS: %s.\n", strerror(-cqe.res));
+        return false;
+    }
+
+    return true;
+}
+
+uint8_t* Uring::Buffer (uint16_t bid) const {
+    return _bufs + (size_t) bid * _buf_sz;
+}
+
+size_t Uring::BufferSize () const {
+    return _buf_sz;
+}
+
+void Uring::RecycleBuffer (uint16_t bid) {
+    _recycled.push_back(bid);
+}
+
+void Uring::PublishBuffers () {
+    if (_recycled.empty()) return;
+
+    // buffers are usually consumed in order, so give them back in runs of
+    // consecutive ids, one request per run.
+    std::sort(_recycled.begin(), _recycled.end());
+
+    size_t i = 0;
+    while (i < _recycled.size()) {
+        size_t j = i + 1;
+        while (j < _recycled.size() && _recycled[j] == _recycled[j - 1] + 1) j++;
+
+        struct io_uring_sqe *sqe = GetSqe();
+
+        if (sqe == nullptr) {
+            log_error("No free io_uring submission entry.\n");
+            break;
+        }
+
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = (int) (j - i);
+        sqe->addr = (uint64_t) (uintptr_t) Buffer(_recycled[i]);
+        sqe->len = _buf_sz;
+        sqe->off = _recycled[i];
+        sqe->buf_group = _bgid;
+        sqe->user_data = PROVIDE_TAG;
+
+        i = j;
+    }
+
+    _recycled.erase(_recycled.begin(), _recycled.begin() + i);
+}
+
+struct io_uring_sqe* Uring::GetSqe () {
+    unsigned head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+
+    if (_sq_local_tail - head >= _sq_entries) {
+        Submit(0);
+        head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+        if (_sq_local_tail - head >= _sq_entries) return nullptr;
+    }
+
+    unsigned idx = _sq_local_tail & *_sq_mask;
+    struct io_uring_sqe *sqe = &_sqes[idx];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    _sq_array[idx] = idx;
+    _sq_local_tail++;
+
+    return sqe;
+}
+
+int Uring::Submit (unsigned wait_nr) {
+    unsigned to_submit = _sq_local_tail - *_sq_tail;
+    __atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+
+    if (to_submit == 0 && wait_nr == 0) return 0;
+
+    int ret;
+    do {
+        ret = io_uring_enter(_fd, to_submit, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+    } while (ret < 0 && errno == EINTR && wait_nr == 0);
+
+    if (ret < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+        log_error("io_uring_enter(): %s.\n", strerror(errno));
+    }
+
+    return ret;
+}
+
+bool Uring::PeekCqe (struct io_uring_cqe &cqe, bool provide) {
+    for (;;) {
+        unsigned head = *_cq_head;
+        unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+
+        if (head == tail) return false;
+
+        cqe = _cqes[head & *_cq_mask];
+        __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+
+        if (cqe.user_data != PROVIDE_TAG || provide) return true;
+
+        if (cqe.res < 0) {
+            log_error("IORING_OP_PROVIDE_BUFFERS: %s.\n", strerror(-cqe.res));
+        }
+    }
+}
+
+bool Uring::HasCqe () const {
+    return !_stash.empty() || *_cq_head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+}
+
+bool Uring::NextCqe (struct io_uring_cqe &cqe) {
+    if (!_stash.empty()) {
+        cqe = _stash.front();
+        _stash.pop_front();
+        return true;
+    }
+
+    return PeekCqe(cqe);
+}
+
+size_t Uring::SendBatch (int fd, struct mmsghdr *msgs, size_t n, int *errors) {
+    size_t inflight = 0;
+    size_t sent = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        struct io_uring_sqe *sqe = GetSqe();
+
+        if (sqe == nullptr) {
+            log_error("No free io_uring submission entry.\n");
+            for (; i < n; i++) errors[i] = EAGAIN;
+            break;
+        }
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t) (uintptr_t) &msgs[i].msg_hdr;
+        sqe->len = 1;
+        sqe->user_data = SEND_TAG | i;
+        inflight++;
+    }
+
+    // buffers must stay untouched until kernel is done with them, so wait
+    // for every send. UDP sends usually complete during submission.
+    Submit(0);
+
+    struct io_uring_cqe cqe;
+    while (inflight > 0) {
+        if (!PeekCqe(cqe)) {
+            Submit(1);
+            continue;
+        }
+
+        if ((cqe.user_data & 0xffffffff00000000ULL) != SEND_TAG) {
+            _stash.push_back(cqe);
+            continue;
+        }
+
+        inflight--;
+        errors[cqe.user_data & 0xffffffffULL] = cqe.res < 0 ? -cqe.res : 0;
+
+        if (cqe.res >= 0) sent++;
+    }
+
+    return sent;
+}
+
+void Uring::Close () {
+    if (_bufs != nullptr) {
+        delete[] _bufs;
+        _bufs = nullptr;
+    }
+
+    if (_sqes != MAP_FAILED) {
+        munmap(_sqes, _sqes_sz);
+        _sqes = (struct io_uring_sqe *) MAP_FAILED;
+    }
+
+    if (_sq_ptr != MAP_FAILED) {
+        munmap(_sq_ptr, _sq_sz);
+        _sq_ptr = _cq_ptr = MAP_FAILED;
+    }
+
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+
+    _stash.clear();
+    _recycled.clear();
+}
+
+}
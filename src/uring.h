@@ -0,0 +1,110 @@
+#ifndef DIST_URING_H
+#define DIST_URING_H
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+#include <deque>
+#include <vector>
+
+namespace distributor {
+
+// Uring: minimal io_uring wrapper (raw syscalls, no liburing), with one
+// group of provided buffers (IORING_OP_PROVIDE_BUFFERS) for multishot
+// receive.
+class Uring {
+public:
+    Uring ();
+    ~Uring ();
+
+    // Create ring with sq_entries submission entries. Return false if
+    // io_uring is not available.
+    bool Init (unsigned sq_entries, unsigned cq_entries);
+
+    // Provide count buffers of size bytes each to kernel as buffer group
+    // bgid. Return false if not supported.
+    bool SetupBuffers (uint16_t bgid, unsigned count, size_t size);
+
+    // Get provided buffer by id.
+    uint8_t* Buffer (uint16_t bid) const;
+
+    // Get size of a provided buffer.
+    size_t BufferSize () const;
+
+    // Give a provided buffer back to kernel. Not visible to kernel until
+    // PublishBuffers().
+    void RecycleBuffer (uint16_t bid);
+
+    // Queue requests giving recycled buffers back to kernel. They are sent
+    // with next Submit().
+    void PublishBuffers ();
+
+    // Get a free submission entry (zeroed). Pending entries are submitted if
+    // the queue is full.
+    struct io_uring_sqe* GetSqe ();
+
+    // Submit pending entries, and wait for at least wait_nr completions.
+    int Submit (unsigned wait_nr);
+
+    // Get next completion, return false if there is none.
+    bool NextCqe (struct io_uring_cqe &cqe);
+
+    // Check if there are completions to get.
+    bool HasCqe () const;
+
+    // Send n messages with IORING_OP_SENDMSG, and wait for all of them to
+    // complete. Other completions seen in the meantime are kept for
+    // NextCqe(). errno of every message (0 if sent) is stored in errors.
+    // Return number of messages sent.
+    size_t SendBatch (int fd, struct mmsghdr *msgs, size_t n, int *errors);
+
+    // Tear down the ring.
+    void Close ();
+
+    // user_data of the SendBatch() completions, ORed with message index.
+    static const uint64_t SEND_TAG = 1ULL << 63;
+
+    // user_data of the PublishBuffers() completions, never returned by
+    // NextCqe().
+    static const uint64_t PROVIDE_TAG = ~0ULL;
+
+private:
+    // Get next completion from the ring itself. PublishBuffers()
+    // completions are skipped unless provide is true.
+    bool PeekCqe (struct io_uring_cqe &cqe, bool provide = false);
+
+    int _fd;
+
+    // submission queue
+    void *_sq_ptr;
+    size_t _sq_sz;
+    unsigned *_sq_head;
+    unsigned *_sq_tail;
+    unsigned *_sq_mask;
+    unsigned *_sq_array;
+    struct io_uring_sqe *_sqes;
+    size_t _sqes_sz;
+    unsigned _sq_local_tail;
+    unsigned _sq_entries;
+
+    // completion queue
+    void *_cq_ptr;
+    unsigned *_cq_head;
+    unsigned *_cq_tail;
+    unsigned *_cq_mask;
+    struct io_uring_cqe *_cqes;
+
+    // provided buffers
+    uint8_t *_bufs;
+    size_t _buf_sz;
+    unsigned _buf_count;
+    uint16_t _bgid;
+    std::vector<uint16_t> _recycled;
+
+    // completions seen while waiting in SendBatch()
+    std::deque<struct io_uring_cqe> _stash;
+};
+
+}
+
+#endif // DIST_URING_H
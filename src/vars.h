@@ -6,6 +6,47 @@
 #define DIST_FDB_AGEING 300
 #endif // DIST_FDB_AGEING
 
+// last seen time of a known fdb entry is updated at most once per this many
+// seconds.
+#ifndef DIST_FDB_REFRESH
+#define DIST_FDB_REFRESH 1
+#endif // DIST_FDB_REFRESH
+
+// fdb entries visited per scavenger tick by the ageing sweep (per worker).
+#ifndef DIST_FDB_AGE_BUDGET
+#define DIST_FDB_AGE_BUDGET 8192
+#endif // DIST_FDB_AGE_BUDGET
+
+// fdb entries of a network kept inline before it spills to the shared table.
+#ifndef DIST_FDB_SMALL
+#define DIST_FDB_SMALL 4
+#endif // DIST_FDB_SMALL
+
+// ports of a network kept inline before its port list goes to heap.
+#ifndef DIST_NET_SMALL
+#define DIST_NET_SMALL 4
+#endif // DIST_NET_SMALL
+
+// known unicast (source, destination) pairs cached per port.
+#ifndef DIST_FLOW_CACHE
+#define DIST_FLOW_CACHE 4
+#endif // DIST_FLOW_CACHE
+
+// max fdb entries learned on one port.
+#ifndef DIST_FDB_MAX_PORT
+#define DIST_FDB_MAX_PORT 4096
+#endif // DIST_FDB_MAX_PORT
+
+// max fdb entries in one network.
+#ifndef DIST_FDB_MAX_NET
+#define DIST_FDB_MAX_NET 65536
+#endif // DIST_FDB_MAX_NET
+
+// max fdb entries in all networks of a worker (switch).
+#ifndef DIST_FDB_MAX
+#define DIST_FDB_MAX 1048576
+#endif // DIST_FDB_MAX
+
 // interval of the keepalive.
 #ifndef DIST_UDP_KEEPALIVE
 #define DIST_UDP_KEEPALIVE 5
@@ -16,12 +57,144 @@
 #define DIST_UDP_RETRIES 12
 #endif
 
-#ifndef DIST_WOROKER_READ_BUFSZ
-#define DIST_WOROKER_READ_BUFSZ 65536
-#endif // DIST_WOROKER_READ_BUFSZ
+// default number of worker threads.
+#ifndef DIST_WORKERS
+#define DIST_WORKERS 1
+#endif // DIST_WORKERS
+
+// upper limit of the number of worker threads.
+#define DIST_WORKERS_MAX 64
+
+// size of the ring used to pass frames between two workers (power of two).
+#ifndef DIST_WORKER_RING_SZ
+#define DIST_WORKER_RING_SZ 1048576
+#endif // DIST_WORKER_RING_SZ
+
+// size of the ring used to pass requests from scavenger to a worker (power
+// of two).
+#ifndef DIST_SCAVENGER_RING_SZ
+#define DIST_SCAVENGER_RING_SZ 65536
+#endif // DIST_SCAVENGER_RING_SZ
+
+// size of the ring used to pass new clients from a worker to scavenger (power
+// of two).
+#ifndef DIST_WATCH_RING_SZ
+#define DIST_WATCH_RING_SZ 65536
+#endif // DIST_WATCH_RING_SZ
+
+// scavenger tick in milliseconds, resolution of client liveness timers.
+#ifndef DIST_SCAVENGER_TICK
+#define DIST_SCAVENGER_TICK 100
+#endif // DIST_SCAVENGER_TICK
+
+// number of slots of the liveness timer wheel (power of two).
+#ifndef DIST_TIMER_WHEEL_SLOTS
+#define DIST_TIMER_WHEEL_SLOTS 1024
+#endif // DIST_TIMER_WHEEL_SLOTS
+
+// max number of datagrams the worker reads with one recvmmsg() call.
+#ifndef DIST_WORKER_BATCH
+#define DIST_WORKER_BATCH 32
+#endif // DIST_WORKER_BATCH
+
+// upper limit of the batch size (recvmmsg() caps vlen at UIO_MAXIOV).
+#define DIST_WORKER_BATCH_MAX 1024
+
+// size of one receive slot. datagrams larger than this are dropped.
+#ifndef DIST_WORKER_SLOT_SZ
+#define DIST_WORKER_SLOT_SZ 9216
+#endif // DIST_WORKER_SLOT_SZ
+
+// size of one receive slot when UDP GRO is used. kernel may coalesce up to
+// 64 KB of datagrams from a client into one.
+#ifndef DIST_WORKER_GRO_SLOT_SZ
+#define DIST_WORKER_GRO_SLOT_SZ 65536
+#endif // DIST_WORKER_GRO_SLOT_SZ
+
+// number of submission queue entries of the io_uring of a worker.
+#ifndef DIST_URING_ENTRIES
+#define DIST_URING_ENTRIES 256
+#endif // DIST_URING_ENTRIES
+
+// max number of datagrams the worker queues before sending them with one
+// sendmmsg() call.
+#ifndef DIST_EGRESS_BATCH
+#define DIST_EGRESS_BATCH 1024
+#endif // DIST_EGRESS_BATCH
+
+// max number of datagrams to the same client sent as one UDP GSO message
+// (UDP_MAX_SEGMENTS of older kernels).
+#ifndef DIST_GSO_MAX_SEGS
+#define DIST_GSO_MAX_SEGS 64
+#endif // DIST_GSO_MAX_SEGS
+
+// largest datagram sent with UDP GSO. GSO segments are not IP fragmented, so
+// this must fit in path MTU (1500 - IP and UDP headers by default).
+#ifndef DIST_GSO_MAX_SEG_SZ
+#define DIST_GSO_MAX_SEG_SZ 1472
+#endif // DIST_GSO_MAX_SEG_SZ
+
+// max log messages per second from one call site, more are suppressed and
+// counted (0: no limit).
+#ifndef DIST_LOG_RATE
+#define DIST_LOG_RATE 10
+#endif // DIST_LOG_RATE
+
+// size of the log ring of a thread (power of two).
+#ifndef DIST_LOG_RING_SZ
+#define DIST_LOG_RING_SZ 65536
+#endif // DIST_LOG_RING_SZ
+
+// max bytes of a string argument kept in a log record.
+#ifndef DIST_LOG_STR_MAX
+#define DIST_LOG_STR_MAX 255
+#endif // DIST_LOG_STR_MAX
+
+// interval in milliseconds the log formatter thread polls rings at when idle.
+#ifndef DIST_LOG_POLL
+#define DIST_LOG_POLL 10
+#endif // DIST_LOG_POLL
+
+// size of a cache line, counters of a thread are padded to it.
+#ifndef DIST_CACHE_LINE
+#define DIST_CACHE_LINE 64
+#endif // DIST_CACHE_LINE
+
+// record forwarding latency (kernel receive timestamp to sendmmsg()) of one
+// in this many frames (0: don't timestamp received datagrams).
+#ifndef DIST_LATENCY_SAMPLE
+#define DIST_LATENCY_SAMPLE 8
+#endif // DIST_LATENCY_SAMPLE
+
+// worker socket buffers are sized for twice the largest burst seen in a
+// scavenger tick, plus this many datagrams per client (receive) or per port
+// sent to (send), of DIST_SOCK_BUF_DGRAM bytes of kernel memory each. They
+// only grow: doubled when kernel drops datagrams or refuses sends, within
+// DIST_SOCK_BUF_MIN and DIST_SOCK_BUF_MAX bytes.
+#ifndef DIST_SOCK_BUF_CLIENT
+#define DIST_SOCK_BUF_CLIENT 4
+#endif // DIST_SOCK_BUF_CLIENT
+
+#ifndef DIST_SOCK_BUF_DGRAM
+#define DIST_SOCK_BUF_DGRAM 2048
+#endif // DIST_SOCK_BUF_DGRAM
+
+#ifndef DIST_SOCK_BUF_MIN
+#define DIST_SOCK_BUF_MIN (1024 * 1024)
+#endif // DIST_SOCK_BUF_MIN
+
+#ifndef DIST_SOCK_BUF_MAX
+#define DIST_SOCK_BUF_MAX (64 * 1024 * 1024)
+#endif // DIST_SOCK_BUF_MAX
+
+// max time in milliseconds to wait for a worker to answer a stats request.
+#ifndef DIST_STATS_TIMEOUT
+#define DIST_STATS_TIMEOUT 1000
+#endif // DIST_STATS_TIMEOUT
 
-#ifndef DIST_CLIENT_SEND_BUFSZ
-#define DIST_CLIENT_SEND_BUFSZ 65536
-#endif // DIST_CLIENT_SEND_BUFSZ
+// max number of ports a worker copies stats of in one round.
+#ifndef DIST_STATS_PORTS
+#define DIST_STATS_PORTS 1024
+#endif // DIST_STATS_PORTS
 
 #endif // DIST_VARS_H
\ No newline at end of file